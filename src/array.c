@@ -29,6 +29,13 @@ void* array_hold(void* array, int count, int item_size) {
     }
 }
 
+// Grow the array to hold at least count items, keeping the ones it has. Used
+// for scratch arrays reused from frame to frame, which only ever grow.
+void* array_reserve(void* array, int count, int item_size) {
+    int length = array_length(array);
+    return count > length ? array_hold(array, count - length, item_size) : array;
+}
+
 int array_length(void* array) {
     return (array != NULL) ? ARRAY_OCCUPIED(array) : 0;
 }
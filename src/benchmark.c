@@ -0,0 +1,334 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "benchmark.h"
+#include "array.h"
+#include "camera.h"
+#include "display.h"
+#include "golden.h"
+#include "loader.h"
+#include "timing.h"
+
+#define NS_PER_MS 1000000.0
+#define MAX_OUTPUT_PATH 512
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+typedef struct {
+	int asset;
+	int method;
+	int frames;
+	int faces;				// submitted per measured frame, on average
+	double avg_ms;
+	double p50_ms;
+	double p90_ms;
+	double p99_ms;
+	double max_ms;
+	double fps;
+	double mtris_per_s;		// faces submitted per second, in millions
+	bool captured;
+	golden_result_t golden;
+} benchmark_result_t;
+
+static struct {
+	bool running;
+	char** asset_paths;
+	int num_assets;
+	int frames_per_run;
+	const char* output_prefix;
+	vec3_t look_at;
+
+	int asset;				// index into asset_paths of the loaded asset
+	int method;
+	int frame;				// of the current run, warmup included
+	uint64_t last_end_ns;
+	uint64_t* frame_ns;		// measured frames of the current run
+	int64_t faces;			// submitted over the measured frames of the current run
+	uint64_t capture_ns;	// spent capturing this frame, not part of its time
+	bool captured;
+	golden_result_t golden;	// of the current run, when captured
+	benchmark_result_t* results;
+} suite;
+
+// Load asset_paths[first] or, when it fails, the next one that loads. Returns
+// false when none of the remaining assets could be loaded.
+static bool load_next_asset(int first) {
+	for (suite.asset = first; suite.asset < suite.num_assets; suite.asset++) {
+		char* path = suite.asset_paths[suite.asset];
+		if (start_async_asset_load(path) && wait_async_load()) {
+			return true;
+		}
+		fprintf(stderr, "Benchmark: skipping %s, could not load it.\n", path);
+	}
+	return false;
+}
+
+// Name of the asset for the tables: the file name without its extension
+static void get_asset_name(int asset, char* name, size_t size) {
+	char* path = suite.asset_paths[asset];
+	char* base = strrchr(path, '/');
+	snprintf(name, size, "%s", base != NULL ? base + 1 : path);
+	char* extension = strrchr(name, '.');
+	if (extension != NULL) {
+		*extension = '\0';
+	}
+}
+
+bool start_benchmark_suite(char* asset_paths[], int num_assets, int frames_per_run, const char* output_prefix, vec3_t look_at) {
+	suite.asset_paths = asset_paths;
+	suite.num_assets = num_assets;
+	suite.frames_per_run = frames_per_run > 0 ? frames_per_run : 1;
+	suite.output_prefix = output_prefix;
+	suite.look_at = look_at;
+	suite.method = 0;
+	suite.frame = 0;
+	suite.last_end_ns = get_time_ns();
+
+	// Settle whatever was loading before the suite took over
+	wait_async_load();
+	suite.running = load_next_asset(0);
+	if (!suite.running) {
+		fprintf(stderr, "Benchmark: no asset could be loaded.\n");
+	}
+	return suite.running;
+}
+
+bool is_benchmark_running(void) {
+	return suite.running;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Camera path: one figure eight around the mesh per run, swinging in close and
+// back out, with the yaw kept on the mesh plus a sway that pushes it partly off
+// screen (and through the clipper) at the extremes.
+////////////////////////////////////////////////////////////////////////////////
+static void place_camera(float t) {
+	float angle = 2 * M_PI * t;
+	vec3_t position = vec3_new(
+		1.5 * sin(angle),
+		0.6 * sin(2 * angle),
+		2.5 * sin(0.5 * angle)
+	);
+	float yaw = atan2(suite.look_at.x - position.x, suite.look_at.z - position.z);
+	yaw += 0.35 * sin(3 * angle);
+
+	update_camera_position(position);
+	rotate_camera_yaw(yaw - get_camera_yaw());
+}
+
+int benchmark_begin_frame(void) {
+	int frame_type = BENCHMARK_FRAME;
+	if (suite.frame == 0) {
+		set_render_method(suite.method);
+		init_camera(vec3_new(0, 0, 0), vec3_new(0, 0, 1));
+		frame_type = BENCHMARK_RUN_STARTED;
+	}
+
+	// Warmup frames hold the start of the path
+	int measured_frame = suite.frame - BENCHMARK_WARMUP_FRAMES;
+	place_camera(measured_frame > 0 ? (float)measured_frame / suite.frames_per_run : 0.0);
+	return frame_type;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Results
+////////////////////////////////////////////////////////////////////////////////
+static int compare_u64(const void* a, const void* b) {
+	uint64_t left = *(const uint64_t*)a;
+	uint64_t right = *(const uint64_t*)b;
+	return left < right ? -1 : left > right;
+}
+
+// Nearest rank percentile of sorted samples
+static double percentile_ms(uint64_t* sorted, int count, int percent) {
+	int index = (count * percent + 99) / 100 - 1;
+	return sorted[index < 0 ? 0 : index] / NS_PER_MS;
+}
+
+static void finish_run(void) {
+	int count = array_length(suite.frame_ns);
+	qsort(suite.frame_ns, count, sizeof(uint64_t), compare_u64);
+
+	uint64_t total_ns = 0;
+	for (int i = 0; i < count; i++) {
+		total_ns += suite.frame_ns[i];
+	}
+
+	benchmark_result_t result;
+	result.asset = suite.asset;
+	result.method = suite.method;
+	result.frames = count;
+	result.faces = (int)((suite.faces + count / 2) / count);
+	result.avg_ms = total_ns / NS_PER_MS / count;
+	result.p50_ms = percentile_ms(suite.frame_ns, count, 50);
+	result.p90_ms = percentile_ms(suite.frame_ns, count, 90);
+	result.p99_ms = percentile_ms(suite.frame_ns, count, 99);
+	result.max_ms = suite.frame_ns[count - 1] / NS_PER_MS;
+	result.fps = total_ns > 0 ? count * 1e9 / total_ns : 0.0;
+	result.mtris_per_s = total_ns > 0 ? suite.faces * 1e3 / total_ns : 0.0;
+	result.captured = suite.captured;
+	result.golden = suite.golden;
+	array_push(suite.results, result);
+	suite.captured = false;
+	memset(&suite.golden, 0, sizeof(suite.golden));
+
+	array_free(suite.frame_ns);
+	suite.frame_ns = NULL;
+	suite.faces = 0;
+}
+
+static const char* get_golden_status(const benchmark_result_t* result) {
+	if (!result->captured) return "off";
+	if (get_golden_mode() == GOLDEN_UPDATE) return result->golden.passed ? "updated" : "fail";
+	if (result->golden.missing) return "missing";
+	return result->golden.passed ? "pass" : "fail";
+}
+
+// PSNR for the tables: empty without a comparison, "inf" when identical
+static void format_psnr(const benchmark_result_t* result, char* text, size_t size) {
+	if (!result->captured || result->golden.missing || get_golden_mode() != GOLDEN_COMPARE) {
+		snprintf(text, size, "%s", "");
+	} else if (isinf(result->golden.psnr_db)) {
+		snprintf(text, size, "%s", "inf");
+	} else {
+		snprintf(text, size, "%.2f", result->golden.psnr_db);
+	}
+}
+
+static void print_results(FILE* file) {
+	fprintf(file, "%-8s %-14s %6s %8s %8s %8s %8s %8s %8s %9s %8s %7s\n",
+		"asset", "method", "faces", "avg ms", "p50 ms", "p90 ms", "p99 ms", "max ms", "fps", "Mtris/s", "psnr dB", "golden");
+	for (int i = 0; i < array_length(suite.results); i++) {
+		benchmark_result_t* result = &suite.results[i];
+		char name[64];
+		get_asset_name(result->asset, name, sizeof(name));
+		char psnr[16];
+		format_psnr(result, psnr, sizeof(psnr));
+		fprintf(file, "%-8s %-14s %6d %8.3f %8.3f %8.3f %8.3f %8.3f %8.1f %9.3f %8s %7s\n",
+			name, get_render_method_name(result->method), result->faces,
+			result->avg_ms, result->p50_ms, result->p90_ms, result->p99_ms, result->max_ms,
+			result->fps, result->mtris_per_s, psnr, get_golden_status(result));
+	}
+	if (get_golden_mode() == GOLDEN_COMPARE) {
+		fprintf(file, "Golden: %d of %d images failed\n", get_golden_failures(), array_length(suite.results));
+	}
+}
+
+static bool write_csv(const char* path) {
+	FILE* file = fopen(path, "w");
+	if (file == NULL) {
+		return false;
+	}
+	fprintf(file, "asset,method,frames,faces,avg_ms,p50_ms,p90_ms,p99_ms,max_ms,fps,mtris_per_s,psnr_db,bad_pixels,golden\n");
+	for (int i = 0; i < array_length(suite.results); i++) {
+		benchmark_result_t* result = &suite.results[i];
+		char name[64];
+		get_asset_name(result->asset, name, sizeof(name));
+		char psnr[16];
+		format_psnr(result, psnr, sizeof(psnr));
+		fprintf(file, "%s,%s,%d,%d,%.4f,%.4f,%.4f,%.4f,%.4f,%.2f,%.4f,%s,%d,%s\n",
+			name, get_render_method_name(result->method), result->frames, result->faces,
+			result->avg_ms, result->p50_ms, result->p90_ms, result->p99_ms, result->max_ms,
+			result->fps, result->mtris_per_s, psnr, result->golden.bad_pixels, get_golden_status(result));
+	}
+	return fclose(file) == 0;
+}
+
+static bool write_json(const char* path) {
+	FILE* file = fopen(path, "w");
+	if (file == NULL) {
+		return false;
+	}
+	fprintf(file, "{\"frames_per_run\":%d,\"warmup_frames\":%d,\"results\":[",
+		suite.frames_per_run, BENCHMARK_WARMUP_FRAMES);
+	for (int i = 0; i < array_length(suite.results); i++) {
+		benchmark_result_t* result = &suite.results[i];
+		char name[64];
+		get_asset_name(result->asset, name, sizeof(name));
+		// JSON has no infinity, identical images are told by "max_difference":0
+		char psnr[16];
+		format_psnr(result, psnr, sizeof(psnr));
+		if (psnr[0] == '\0' || strcmp(psnr, "inf") == 0) {
+			snprintf(psnr, sizeof(psnr), "%s", "null");
+		}
+		fprintf(file,
+			"%s\n{\"asset\":\"%s\",\"method\":\"%s\",\"frames\":%d,\"faces\":%d,"
+			"\"avg_ms\":%.4f,\"p50_ms\":%.4f,\"p90_ms\":%.4f,\"p99_ms\":%.4f,\"max_ms\":%.4f,"
+			"\"fps\":%.2f,\"mtris_per_s\":%.4f,"
+			"\"psnr_db\":%s,\"bad_pixels\":%d,\"max_difference\":%d,\"golden\":\"%s\"}",
+			i > 0 ? "," : "", name, get_render_method_name(result->method), result->frames, result->faces,
+			result->avg_ms, result->p50_ms, result->p90_ms, result->p99_ms, result->max_ms,
+			result->fps, result->mtris_per_s,
+			psnr, result->golden.bad_pixels, result->golden.max_difference, get_golden_status(result));
+	}
+	fprintf(file, "\n]}\n");
+	return fclose(file) == 0;
+}
+
+static void finish_suite(void) {
+	suite.running = false;
+	print_results(stdout);
+
+	char path[MAX_OUTPUT_PATH];
+	snprintf(path, sizeof(path), "%s.csv", suite.output_prefix);
+	if (write_csv(path)) printf("Wrote %s\n", path);
+	else fprintf(stderr, "Benchmark: could not write %s\n", path);
+
+	snprintf(path, sizeof(path), "%s.json", suite.output_prefix);
+	if (write_json(path)) printf("Wrote %s\n", path);
+	else fprintf(stderr, "Benchmark: could not write %s\n", path);
+
+	array_free(suite.results);
+	suite.results = NULL;
+}
+
+// The last frame of every run, when golden images are on
+bool is_benchmark_capture_frame(void) {
+	return suite.running && get_golden_mode() != GOLDEN_OFF
+		&& suite.frame == BENCHMARK_WARMUP_FRAMES + suite.frames_per_run - 1;
+}
+
+void capture_benchmark_frame(const framebuffer_t* framebuffer) {
+	uint64_t start = get_time_ns();
+	char asset_name[64];
+	char name[128];
+	get_asset_name(suite.asset, asset_name, sizeof(asset_name));
+	snprintf(name, sizeof(name), "%s_%s", asset_name, get_render_method_name(suite.method));
+
+	suite.golden = check_golden_image(name, framebuffer, suite.frame + 1);
+	suite.captured = true;
+	suite.capture_ns = get_time_ns() - start;
+}
+
+// Returns false once the last run is done and the tables are written
+bool benchmark_end_frame(int faces) {
+	if (!suite.running) {
+		return false;
+	}
+	uint64_t now = get_time_ns();
+	if (suite.frame >= BENCHMARK_WARMUP_FRAMES) {
+		array_push(suite.frame_ns, now - suite.last_end_ns - suite.capture_ns);
+		suite.faces += faces;
+	}
+	suite.capture_ns = 0;
+	suite.frame++;
+
+	if (suite.frame == BENCHMARK_WARMUP_FRAMES + suite.frames_per_run) {
+		finish_run();
+		suite.frame = 0;
+		suite.method++;
+		if (suite.method == RENDER_NONE) {
+			suite.method = 0;
+			if (!load_next_asset(suite.asset + 1)) {
+				finish_suite();
+				return false;
+			}
+		}
+	}
+	// Asset loads between runs are not part of the next frame
+	suite.last_end_ns = get_time_ns();
+	return true;
+}
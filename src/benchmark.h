@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdbool.h>
+#include "framebuffer.h"
+#include "vector.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// Scripted benchmark suite
+////////////////////////////////////////////////////////////////////////////////
+// Renders every asset with every render method for a fixed number of frames
+// while flying the camera along the same scripted path, then writes a table of
+// frame time percentiles and throughput to <prefix>.csv and <prefix>.json.
+//
+// The main loop calls benchmark_begin_frame() before building a frame, which
+// switches render method and places the camera on the path around look_at.
+// It calls benchmark_end_frame() after presenting the frame, with the number
+// of faces the frame submitted. That count sums the faces of the level of
+// detail drawn for each object that was not culled. benchmark_end_frame()
+// also loads the next asset between runs.
+//
+// Frame times are taken between consecutive benchmark_end_frame() calls, so
+// they cover everything the loop does, present included. The first
+// BENCHMARK_WARMUP_FRAMES of every run are rendered but not measured.
+//
+// With golden images on (see golden.h) the last frame of every run is captured
+// as <asset>_<method> between rasterizing and presenting it, and the outcome
+// is added to the tables. The capture is left out of the frame time.
+
+#define BENCHMARK_WARMUP_FRAMES 10
+
+enum benchmark_frame {
+	BENCHMARK_FRAME,		// next frame of the current run
+	BENCHMARK_RUN_STARTED	// first frame of a new run, reset any animation
+};
+
+bool start_benchmark_suite(char* asset_paths[], int num_assets, int frames_per_run, const char* output_prefix, vec3_t look_at);
+bool is_benchmark_running(void);
+int benchmark_begin_frame(void);
+bool benchmark_end_frame(int faces);
+bool is_benchmark_capture_frame(void);
+void capture_benchmark_frame(const framebuffer_t* framebuffer);
@@ -35,10 +35,11 @@ void init_frustrum_planes(float fov_x, float fov_y, float z_near, float z_far) {
     frustrum_planes[FAR_FRUSTRUM_PLANE].normal = vec3_new(0, 0, -1);
 }
 
-polygon_t polygon_from_triangle(vec3_t v0, vec3_t v1, vec3_t v2, tex2_t t0, tex2_t t1, tex2_t t2) {
+polygon_t polygon_from_triangle(vec3_t v0, vec3_t v1, vec3_t v2, tex2_t t0, tex2_t t1, tex2_t t2, float s0, float s1, float s2) {
     polygon_t polygon = {
         .vertices = { v0, v1, v2 },
         .texcoords = { t0, t1, t2 },
+        .shades = { s0, s1, s2 },
         .num_vertices = 3
     };
     return polygon;
@@ -56,38 +57,95 @@ void triangles_from_polygon(polygon_t* polygon, triangle_t triangles[], int* num
         triangles[i].texcoords[0] = polygon->texcoords[index0];
         triangles[i].texcoords[1] = polygon->texcoords[index1];
         triangles[i].texcoords[2] = polygon->texcoords[index2];
+        triangles[i].shades[0] = polygon->shades[index0];
+        triangles[i].shades[1] = polygon->shades[index1];
+        triangles[i].shades[2] = polygon->shades[index2];
     }
     *num_triangles = polygon->num_vertices - 2;
 }
 
-void clip_polygon(polygon_t* polygon) {
-    clip_polygon_against_plane(polygon, LEFT_FRUSTRUM_PLANE);
-    clip_polygon_against_plane(polygon, RIGHT_FRUSTRUM_PLANE);
-    clip_polygon_against_plane(polygon, TOP_FRUSTRUM_PLANE);
-    clip_polygon_against_plane(polygon, BOTTOM_FRUSTRUM_PLANE);
-    clip_polygon_against_plane(polygon, NEAR_FRUSTRUM_PLANE);
-    clip_polygon_against_plane(polygon, FAR_FRUSTRUM_PLANE);
+// Returns true when the frustrum cut the polygon or removed it entirely
+bool clip_polygon(polygon_t* polygon) {
+    bool clipped = false;
+    clipped |= clip_polygon_against_plane(polygon, LEFT_FRUSTRUM_PLANE);
+    clipped |= clip_polygon_against_plane(polygon, RIGHT_FRUSTRUM_PLANE);
+    clipped |= clip_polygon_against_plane(polygon, TOP_FRUSTRUM_PLANE);
+    clipped |= clip_polygon_against_plane(polygon, BOTTOM_FRUSTRUM_PLANE);
+    clipped |= clip_polygon_against_plane(polygon, NEAR_FRUSTRUM_PLANE);
+    clipped |= clip_polygon_against_plane(polygon, FAR_FRUSTRUM_PLANE);
+    return clipped;
 }
 
 float float_lerp(float a, float b, float t) {
     return a + t * (b - a);
 }
 
-void clip_polygon_against_plane(polygon_t* polygon, int plane) {
+static vec3_t vec3_lerp(vec3_t a, vec3_t b, float t) {
+    vec3_t result = {
+        .x = float_lerp(a.x, b.x, t),
+        .y = float_lerp(a.y, b.y, t),
+        .z = float_lerp(a.z, b.z, t),
+    };
+    return result;
+}
+
+// Clip the segment a-b against all frustrum planes in place, false when no
+// part of it is inside
+bool clip_line(vec3_t* a, vec3_t* b) {
+    for (int plane = 0; plane < NUM_PLANES; plane++) {
+        vec3_t plane_point = frustrum_planes[plane].point;
+        vec3_t plane_normal = frustrum_planes[plane].normal;
+        float dot_a = vec3_dot(vec3_sub(*a, plane_point), plane_normal);
+        float dot_b = vec3_dot(vec3_sub(*b, plane_point), plane_normal);
+
+        if (dot_a < 0 && dot_b < 0) {
+            return false;
+        }
+        if (dot_a < 0) {
+            *a = vec3_lerp(*a, *b, dot_a / (dot_a - dot_b));
+        } else if (dot_b < 0) {
+            *b = vec3_lerp(*b, *a, dot_b / (dot_b - dot_a));
+        }
+    }
+    return true;
+}
+
+// True when the whole sphere is behind one of the frustrum planes, so anything
+// inside it would be clipped away
+bool is_sphere_outside_frustrum(vec3_t center, float radius) {
+    for (int plane = 0; plane < NUM_PLANES; plane++) {
+        float distance = vec3_dot(vec3_sub(center, frustrum_planes[plane].point), frustrum_planes[plane].normal);
+        if (distance < -radius) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool clip_polygon_against_plane(polygon_t* polygon, int plane) {
+    // Already removed entirely by an earlier plane
+    if (polygon->num_vertices == 0) {
+        return false;
+    }
+
     vec3_t plane_point = frustrum_planes[plane].point;
     vec3_t plane_normal = frustrum_planes[plane].normal;
 
     // Part of final polygon
     vec3_t inside_vertices[MAX_NUM_POLY_VERTICES];
     tex2_t inside_texcoords[MAX_NUM_POLY_VERTICES];
+    float inside_shades[MAX_NUM_POLY_VERTICES];
     int num_inside_vertices = 0;
 
     vec3_t* current_vertex = &polygon->vertices[0];
     tex2_t* current_texcoord = &polygon->texcoords[0];
+    float* current_shade = &polygon->shades[0];
 
     vec3_t* previous_vertex = &polygon->vertices[polygon->num_vertices - 1];
     tex2_t* previous_texcoord = &polygon->texcoords[polygon->num_vertices - 1];
+    float* previous_shade = &polygon->shades[polygon->num_vertices - 1];
 
+    bool clipped = false;
     float current_dot = 0;
     float previous_dot = vec3_dot(vec3_sub(*previous_vertex, plane_point), plane_normal);
 
@@ -125,26 +183,36 @@ void clip_polygon_against_plane(polygon_t* polygon, int plane) {
 
             inside_vertices[num_inside_vertices] = vec3_clone(&intersection_point);
             inside_texcoords[num_inside_vertices] = tex2_clone(&interpolated_texcoord);
+            inside_shades[num_inside_vertices] = float_lerp(*previous_shade, *current_shade, t);
             num_inside_vertices++;
         }
 
+        if (current_dot <= 0) {
+            clipped = true;
+        }
+
         if (current_dot > 0) {
             inside_vertices[num_inside_vertices] = vec3_clone(current_vertex);
             inside_texcoords[num_inside_vertices] = tex2_clone(current_texcoord);
+            inside_shades[num_inside_vertices] = *current_shade;
             num_inside_vertices++;
         }
 
         previous_dot = current_dot;
         previous_vertex = current_vertex;
         previous_texcoord = current_texcoord;
+        previous_shade = current_shade;
         current_vertex++; // pointer arithmetic, set to next array element
         current_texcoord++;
+        current_shade++;
     }
 
     // TODO: copy inside vertices to destination polygon
     for (int i = 0; i < num_inside_vertices; i++) {
         polygon->vertices[i] = vec3_clone(&inside_vertices[i]);
         polygon->texcoords[i] = tex2_clone(&inside_texcoords[i]);
+        polygon->shades[i] = inside_shades[i];
     }
     polygon->num_vertices = num_inside_vertices;
+    return clipped;
 }
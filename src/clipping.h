@@ -23,11 +23,14 @@ typedef struct {
 typedef struct {
     vec3_t vertices[MAX_NUM_POLY_VERTICES];
     tex2_t texcoords[MAX_NUM_POLY_VERTICES];
+    float shades[MAX_NUM_POLY_VERTICES];
     int num_vertices;
 } polygon_t;
 
 void init_frustrum_planes(float fov_x, float fov_y, float z_near, float z_far);
-polygon_t polygon_from_triangle(vec3_t v0, vec3_t v1, vec3_t v2, tex2_t t0, tex2_t t1, tex2_t t2);
-void clip_polygon(polygon_t* polygon);
-void clip_polygon_against_plane(polygon_t* polygon, int plane);
+polygon_t polygon_from_triangle(vec3_t v0, vec3_t v1, vec3_t v2, tex2_t t0, tex2_t t1, tex2_t t2, float s0, float s1, float s2);
+bool clip_polygon(polygon_t* polygon);
+bool clip_polygon_against_plane(polygon_t* polygon, int plane);
+bool clip_line(vec3_t* a, vec3_t* b);
+bool is_sphere_outside_frustrum(vec3_t center, float radius);
 void triangles_from_polygon(polygon_t* polygon, triangle_t triangles[], int* num_triangles);
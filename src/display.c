@@ -1,17 +1,49 @@
+#include <string.h>
 #include "display.h"
+#include "framebuffer.h"
+#include "profiler.h"
 
 static SDL_Window* window = NULL;
 static SDL_Renderer* renderer = NULL;
 
+// color_buffer points either at owned_color_buffer (PRESENT_COPY) or into the
+// locked streaming texture (PRESENT_LOCKED), whose rows are color_buffer_pitch
+// pixels apart
 static uint32_t* color_buffer = NULL;
-static float* z_buffer = NULL;
-
-static SDL_Texture* color_buffer_texture = NULL;
+static uint32_t* owned_color_buffer = NULL;
+static int color_buffer_pitch = 0;
+static void* z_buffer = NULL;	// element type depends on depth_format
+static int depth_format = DEPTH_FLOAT;
+static int depth_bytes = sizeof(float);
+static float depth_near = 1.0;
+
+// Clear color and grid, copied into color buffer tiles (see clear_color_buffer)
+static uint32_t* background_buffer = NULL;
+static uint8_t* color_tile_ready = NULL;
+static uint8_t* z_tile_ready = NULL;
+static int tiles_x = 0;
+static int tiles_y = 0;
+
+static SDL_Texture* color_buffer_textures[MAX_PRESENT_TEXTURES] = { NULL };
+static int num_present_textures = 2;
+static int present_texture_index = 0;
+static int present_mode = PRESENT_LOCKED;
+static bool color_buffer_locked = false;
+
+// The buffers are allocated at buffer_width x buffer_height. The frame is
+// rendered into the top-left window_width x window_height of them, which
+// shrinks with the render scale and is stretched over the window at present.
+static int buffer_width = 320;
+static int buffer_height = 200;
 static int window_width = 320;
 static int window_height = 200;
+static float render_scale = 1.0;
+static scissor_t scissor = { 0, 0, 319, 199 };
 
 static int render_method = 0;
 static int cull_method = 0;
+static bool depth_test = true;
+static bool depth_write = true;
 
 int get_window_height(void) {
     return window_height;
@@ -21,10 +53,39 @@ int get_window_width(void) {
     return window_width;
 }
 
+// Render at a fraction of the allocated resolution (the frame is stretched to
+// the window at present). Call between frames: the size changes immediately.
+void set_render_scale(float scale) {
+    if (scale < MIN_RENDER_SCALE) scale = MIN_RENDER_SCALE;
+    if (scale > 1.0) scale = 1.0;
+    render_scale = scale;
+    window_width = (int)(buffer_width * scale + 0.5);
+    window_height = (int)(buffer_height * scale + 0.5);
+    if (window_width < 1) window_width = 1;
+    if (window_height < 1) window_height = 1;
+    reset_scissor();
+}
+
+float get_render_scale(void) {
+    return render_scale;
+}
+
 void set_render_method(int method) {
     render_method = method;
 }
 
+int get_render_method(void) {
+    return render_method;
+}
+
+const char* get_render_method_name(int method) {
+    static const char* names[] = {
+        "wire", "wire_vertex", "fill", "fill_wire",
+        "textured", "textured_wire", "gouraud", "gouraud_wire", "overdraw", "none"
+    };
+    return method >= 0 && method <= RENDER_NONE ? names[method] : "unknown";
+}
+
 void set_cull_method(int method) {
     cull_method = method;
 }
@@ -33,6 +94,81 @@ bool is_cull_backface(void) {
     return cull_method == CULL_BACKFACE;
 }
 
+// Takes effect at initialize_window
+void set_depth_format(int format) {
+    if (z_buffer != NULL || format < 0 || format >= NUM_DEPTH_FORMATS) {
+        return;
+    }
+    depth_format = format;
+    depth_bytes = format == DEPTH_UNORM16 ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+int get_depth_format(void) {
+    return depth_format;
+}
+
+// Near plane distance: the unorm formats store z_near/w, which is 1 at the near plane
+void set_depth_near(float z_near) {
+    depth_near = z_near;
+}
+
+void set_depth_test(bool enabled) {
+    depth_test = enabled;
+}
+
+void set_depth_write(bool enabled) {
+    depth_write = enabled;
+}
+
+bool is_depth_test_enabled(void) {
+    return depth_test;
+}
+
+bool is_depth_write_enabled(void) {
+    return depth_write;
+}
+
+void set_present_mode(int mode) {
+    present_mode = mode;
+}
+
+int get_present_mode(void) {
+    return present_mode;
+}
+
+// Number of streaming textures rotated through in PRESENT_LOCKED mode, so the
+// one being drawn into is not the one the GPU may still be reading from.
+// Takes effect at initialize_window.
+void set_present_texture_count(int count) {
+    if (count < 1) count = 1;
+    if (count > MAX_PRESENT_TEXTURES) count = MAX_PRESENT_TEXTURES;
+    num_present_textures = count;
+}
+
+static bool create_present_textures(int count) {
+	for (int i = 0; i < count; i++) {
+		color_buffer_textures[i] = SDL_CreateTexture(
+			renderer, 
+			SDL_PIXELFORMAT_ARGB8888,
+			SDL_TEXTUREACCESS_STREAMING,
+			buffer_width,
+			buffer_height
+		);
+		if (!color_buffer_textures[i]) {
+			fprintf(stderr, "Error creating SDL texture.\n");
+			return false;
+		}
+	}
+	return true;
+}
+
+static void destroy_present_textures(void) {
+	for (int i = 0; i < MAX_PRESENT_TEXTURES; i++) {
+		if (color_buffer_textures[i]) SDL_DestroyTexture(color_buffer_textures[i]);
+		color_buffer_textures[i] = NULL;
+	}
+}
+
 bool initialize_window(void) {
     if (SDL_Init(SDL_INIT_EVERYTHING) != 0) {
         fprintf(stderr, "Error intializing SDL.\n");
@@ -46,10 +182,14 @@ bool initialize_window(void) {
     int fullscreen_width = display_mode.w;
     int fullscreen_height = display_mode.h;
 
-    window_width = fullscreen_width / 2;
-    window_height = fullscreen_height / 2;
+    buffer_width = fullscreen_width / 2;
+    buffer_height = fullscreen_height / 2;
+    window_width = buffer_width;
+    window_height = buffer_height;
+    render_scale = 1.0;
+    reset_scissor();
 
-    SDL_Window* window = SDL_CreateWindow(
+    window = SDL_CreateWindow(
         NULL,  // NULL for no window border (no title)
         SDL_WINDOWPOS_CENTERED,
         SDL_WINDOWPOS_CENTERED,
@@ -61,66 +201,173 @@ bool initialize_window(void) {
         return false;
     }
 
+    // SDL_SetWindowFullscreen(window, SDL_WINDOW_FULLSCREEN);  // without this, taskbar shows (fake fullscreen)
+
+	// Allocate required memory in bytes to hold color buffer
+	owned_color_buffer = (uint32_t*)malloc(sizeof(uint32_t) * buffer_width * buffer_height);
+	z_buffer = malloc((size_t)depth_bytes * buffer_width * buffer_height);
+	background_buffer = (uint32_t*)calloc(buffer_width * buffer_height, sizeof(uint32_t));
+	tiles_x = (buffer_width + FRAMEBUFFER_TILE_SIZE - 1) / FRAMEBUFFER_TILE_SIZE;
+	tiles_y = (buffer_height + FRAMEBUFFER_TILE_SIZE - 1) / FRAMEBUFFER_TILE_SIZE;
+	color_tile_ready = (uint8_t*)calloc(tiles_x * tiles_y, 1);
+	z_tile_ready = (uint8_t*)calloc(tiles_x * tiles_y, 1);
+	color_buffer = owned_color_buffer;
+	color_buffer_pitch = buffer_width;
+
     renderer = SDL_CreateRenderer(window, -1, 0);
     if (!renderer) {
         fprintf(stderr, "Error creating SDL renderer.\n");
         return false;
     }
-    // SDL_SetWindowFullscreen(window, SDL_WINDOW_FULLSCREEN);  // without this, taskbar shows (fake fullscreen)
 
-	// Allocate required memory in bytes to hold color buffer
-	color_buffer = (uint32_t*)malloc(sizeof(uint32_t) * window_width * window_height);
-	z_buffer = (float*)malloc(sizeof(float) * window_width * window_height);
-
-	// SDL texture used to display color buffer
-	color_buffer_texture = SDL_CreateTexture(
-		renderer, 
-		SDL_PIXELFORMAT_RGBA32,
-		SDL_TEXTUREACCESS_STREAMING,
-		window_width,
-		window_height
-	);
+	// SDL textures used to display color buffer
+    return create_present_textures(num_present_textures);
+}
 
-    return true;
+////////////////////////////////////////////////////////////////////////////////
+// Lazy clears: clearing only marks every tile stale. A tile is restored from
+// the precomputed background (and its depth reset) when something is first
+// drawn into it, and the color tiles nothing touched are restored at present.
+// Each tile is cleared at most once per frame, while it is hot in the cache
+// for the draw that follows, and tiles nothing is drawn into never get their
+// depth cleared at all.
+////////////////////////////////////////////////////////////////////////////////
+static void restore_color_tile(int tile_x, int tile_y) {
+    uint64_t profile_start = profile_begin();
+    int x0 = tile_x * FRAMEBUFFER_TILE_SIZE;
+    int y0 = tile_y * FRAMEBUFFER_TILE_SIZE;
+    int width = window_width - x0 < FRAMEBUFFER_TILE_SIZE ? window_width - x0 : FRAMEBUFFER_TILE_SIZE;
+    int y1 = window_height - y0 < FRAMEBUFFER_TILE_SIZE ? window_height : y0 + FRAMEBUFFER_TILE_SIZE;
+    for (int y = y0; y < y1; y++) {
+        memcpy(&color_buffer[color_buffer_pitch * y + x0], &background_buffer[buffer_width * y + x0], sizeof(uint32_t) * width);
+    }
+    color_tile_ready[tiles_x * tile_y + tile_x] = 1;
+    profile_end(PROFILE_CLEAR, profile_start);
 }
 
-void render_color_buffer(void) {
-    SDL_UpdateTexture(
-        color_buffer_texture,
-        NULL,
-        color_buffer,
-        (int)window_width * sizeof(uint32_t));
-    SDL_RenderCopy(renderer, color_buffer_texture, NULL, NULL);
-	SDL_RenderPresent(renderer);
+static void clear_z_tile(int tile_x, int tile_y) {
+    uint64_t profile_start = profile_begin();
+    int x0 = tile_x * FRAMEBUFFER_TILE_SIZE;
+    int y0 = tile_y * FRAMEBUFFER_TILE_SIZE;
+    int x1 = window_width - x0 < FRAMEBUFFER_TILE_SIZE ? window_width : x0 + FRAMEBUFFER_TILE_SIZE;
+    int y1 = window_height - y0 < FRAMEBUFFER_TILE_SIZE ? window_height : y0 + FRAMEBUFFER_TILE_SIZE;
+    for (int y = y0; y < y1; y++) {
+        char* row = (char*)z_buffer + (size_t)depth_bytes * buffer_width * y;
+        if (depth_format == DEPTH_FLOAT) {
+            float* depth_row = (float*)row;
+            for (int x = x0; x < x1; x++) {
+                depth_row[x] = 1.0;
+            }
+        } else {
+            // Reversed formats clear to zero, the far end
+            memset(row + (size_t)depth_bytes * x0, 0, (size_t)depth_bytes * (x1 - x0));
+        }
+    }
+    z_tile_ready[tiles_x * tile_y + tile_x] = 1;
+    profile_end(PROFILE_CLEAR, profile_start);
+}
+
+// Make the tiles overlapping the (inclusive) pixel rectangle ready to draw into.
+// Every drawing function calls this for its bounds before writing pixels.
+void prepare_framebuffer_rect(int x0, int y0, int x1, int y1) {
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+    if (x1 >= window_width) x1 = window_width - 1;
+    if (y1 >= window_height) y1 = window_height - 1;
+    if (x0 > x1 || y0 > y1) {
+        return;
+    }
+    for (int tile_y = y0 / FRAMEBUFFER_TILE_SIZE; tile_y <= y1 / FRAMEBUFFER_TILE_SIZE; tile_y++) {
+        for (int tile_x = x0 / FRAMEBUFFER_TILE_SIZE; tile_x <= x1 / FRAMEBUFFER_TILE_SIZE; tile_x++) {
+            int tile = tiles_x * tile_y + tile_x;
+            if (!color_tile_ready[tile]) restore_color_tile(tile_x, tile_y);
+            if (!z_tile_ready[tile]) clear_z_tile(tile_x, tile_y);
+        }
+    }
+}
+
+// Restore the color tiles nothing was drawn into, right before present or
+// before the frame is read back
+void resolve_color_tiles(void) {
+    int active_tiles_x = (window_width + FRAMEBUFFER_TILE_SIZE - 1) / FRAMEBUFFER_TILE_SIZE;
+    int active_tiles_y = (window_height + FRAMEBUFFER_TILE_SIZE - 1) / FRAMEBUFFER_TILE_SIZE;
+    for (int tile_y = 0; tile_y < active_tiles_y; tile_y++) {
+        for (int tile_x = 0; tile_x < active_tiles_x; tile_x++) {
+            if (!color_tile_ready[tiles_x * tile_y + tile_x]) restore_color_tile(tile_x, tile_y);
+        }
+    }
+}
+
+void clear_color_buffer(void) {
+    memset(color_tile_ready, 0, tiles_x * tiles_y);
+}
+
+void clear_z_buffer(void) {
+    memset(z_tile_ready, 0, tiles_x * tiles_y);
+}
+
+// Point color_buffer at the memory the frame is rasterized into. In
+// PRESENT_LOCKED mode that is the next streaming texture itself, which saves
+// the full-frame copy SDL_UpdateTexture would make at present time.
+void begin_color_buffer(void) {
+    color_buffer = owned_color_buffer;
+    color_buffer_pitch = buffer_width;
+    if (present_mode != PRESENT_LOCKED) {
+        return;
+    }
+
+    void* pixels;
+    int pitch;
+    SDL_Texture* texture = color_buffer_textures[present_texture_index];
+    if (SDL_LockTexture(texture, NULL, &pixels, &pitch) != 0) {
+        fprintf(stderr, "Error locking SDL texture, falling back to copying: %s\n", SDL_GetError());
+        present_mode = PRESENT_COPY;
+        return;
+    }
+    color_buffer = (uint32_t*)pixels;
+    color_buffer_pitch = pitch / (int)sizeof(uint32_t);
+    color_buffer_locked = true;
 }
 
-void clear_color_buffer(uint32_t color) {
-    // for (int y = 0; y < window_height; y++) {
-    //     for (int x = 0; x < window_width; x++) {
-    //         color_buffer[window_width * y + x] = color;
-    //     }
-    // }
-    for (int i = 0; i < window_height * window_width; i++) {
-        color_buffer[i] = color;
+void render_color_buffer(void) {
+    resolve_color_tiles();
+
+
+    SDL_Texture* texture = color_buffer_textures[present_texture_index];
+    if (color_buffer_locked) {
+        SDL_UnlockTexture(texture);
+        color_buffer_locked = false;
+        present_texture_index = (present_texture_index + 1) % num_present_textures;
+    } else {
+        SDL_UpdateTexture(
+            texture,
+            NULL,
+            color_buffer,
+            (int)buffer_width * sizeof(uint32_t));
     }
+    SDL_Rect source = { 0, 0, window_width, window_height };
+    SDL_RenderCopy(renderer, texture, &source, NULL);
+	SDL_RenderPresent(renderer);
 }
 
-void clear_z_buffer() {
-    // for (int y = 0; y < window_height; y++) {
-    //     for (int x = 0; x < window_width; x++) {
-    //         z_buffer[window_width * y + x] = 1.0;
-    //     }
-    // }
-    for (int i = 0; i < window_height * window_width; i++) {
-        z_buffer[i] = 1.0;
+////////////////////////////////////////////////////////////////////////////////
+// Background, built once and copied into the color buffer by the clears above
+////////////////////////////////////////////////////////////////////////////////
+void set_background(uint32_t color) {
+    for (int i = 0; i < buffer_width * buffer_height; i++) {
+        background_buffer[i] = color;
     }
 }
 
 void draw_grid(uint32_t interval, uint32_t color) {
-    for (int y = 0; y < window_height; y++) {
-        for (int x = 0; x < window_width; x++) {
-            if (y % interval == 0 || x % interval == 0)
-                color_buffer[window_width * y + x] = color;
+    for (int y = 0; y < buffer_height; y += interval) {
+        for (int x = 0; x < buffer_width; x++) {
+            background_buffer[buffer_width * y + x] = color;
+        }
+    }
+    for (int y = 0; y < buffer_height; y++) {
+        for (int x = 0; x < buffer_width; x += interval) {
+            background_buffer[buffer_width * y + x] = color;
         }
     }
 }
@@ -137,8 +384,8 @@ void draw_gradient_to_black_background(uint32_t color) {
     // factor is the total number of smallest decrements available to reduce
     // exactly to black at the bottom of screen
     
-    for (int i = 0; i <= window_height; i++) {
-        float ratio = 1.0f - ((float)(i) / (float)window_height);
+    for (int i = 0; i < buffer_height; i++) {
+        float ratio = 1.0f - ((float)(i) / (float)buffer_height);
 
         uint8_t red = (uint8_t)(original_red * ratio);
         uint8_t green = (uint8_t)(original_green * ratio);
@@ -146,31 +393,62 @@ void draw_gradient_to_black_background(uint32_t color) {
 
         uint32_t gradient_color = 0xFF000000 | (red << 16) | (green << 8) | blue;
 
-        for (int j = 0; j <= window_width; j++) {
-            color_buffer[window_width * i + j] = gradient_color;
+        for (int j = 0; j < buffer_width; j++) {
+            background_buffer[buffer_width * i + j] = gradient_color;
         }
     }
 }
 
+framebuffer_t get_framebuffer(void) {
+    framebuffer_t framebuffer = {
+        .color = color_buffer,
+        .depth = z_buffer,
+        .color_pitch = color_buffer_pitch,
+        .depth_pitch = depth_bytes * buffer_width,
+        .depth_format = depth_format,
+        .depth_scale = depth_near * (depth_format == DEPTH_UNORM16 ? DEPTH_UNORM16_MAX : DEPTH_UNORM24_MAX),
+        .width = window_width,
+        .height = window_height,
+        .scissor = scissor
+    };
+    return framebuffer;
+}
+
+// Limit all drawing to the inclusive rectangle, clamped to the window
+void set_scissor(int x0, int y0, int x1, int y1) {
+    scissor.x0 = x0 < 0 ? 0 : x0;
+    scissor.y0 = y0 < 0 ? 0 : y0;
+    scissor.x1 = x1 >= window_width ? window_width - 1 : x1;
+    scissor.y1 = y1 >= window_height ? window_height - 1 : y1;
+}
+
+void reset_scissor(void) {
+    set_scissor(0, 0, window_width - 1, window_height - 1);
+}
+
 void draw_pixel(int x, int y, uint32_t color) {
-    if (x < 0 || x >= window_width || y < 0 || y >= window_height) {
+    if (x < scissor.x0 || x > scissor.x1 || y < scissor.y0 || y > scissor.y1) {
         return;
     }
-    color_buffer[window_width * y + x] = color;
+    color_buffer[color_buffer_pitch * y + x] = color;
 }
 
 void draw_rect(uint32_t x, uint32_t y, uint32_t width, uint32_t height, uint32_t color) {
+    prepare_framebuffer_rect((int)x, (int)y, (int)(x + width), (int)(y + height));
     for (int i = y; i <= y + height; i++) {
         for (int j = x; j <= x + width; j++) {
+            // Through draw_pixel: rects at the window edge must not write past
+            // the rows, which may be texture memory
             if ((i == y || i == y + height) && (j >= x && j <= x + width))
-                color_buffer[window_width * i + j] = color;
+                draw_pixel(j, i, color);
             if ((j == x || j == x + width) && (i >= y && i <= y + height))
-                color_buffer[window_width * i + j] = color;
+                draw_pixel(j, i, color);
         }
     }
 }
 
 void draw_fill_rect(uint32_t x, uint32_t y, uint32_t width, uint32_t height, uint32_t color) {
+    prepare_framebuffer_rect((int)x, (int)y, (int)(x + width), (int)(y + height));
     for (int i = y; i <= y + height; i++) {
         for (int j = x; j <= x + width; j++) {
             draw_pixel(j, i, color);
@@ -178,22 +456,100 @@ void draw_fill_rect(uint32_t x, uint32_t y, uint32_t width, uint32_t height, uin
     }
 }
 
-// naive DDA line algorithm
-void draw_line(int x0, int y0, int x1, int y1, uint32_t color) {
-    int x_len = (x1 - x0);
-    int y_len = (y1 - y0);
+// Cohen-Sutherland region of a point relative to the scissor
+#define OUTCODE_LEFT 1
+#define OUTCODE_RIGHT 2
+#define OUTCODE_TOP 4
+#define OUTCODE_BOTTOM 8
+
+static int scissor_outcode(int x, int y) {
+    int code = 0;
+    if (x < scissor.x0) code |= OUTCODE_LEFT;
+    else if (x > scissor.x1) code |= OUTCODE_RIGHT;
+    if (y < scissor.y0) code |= OUTCODE_TOP;
+    else if (y > scissor.y1) code |= OUTCODE_BOTTOM;
+    return code;
+}
 
-    int longer_side_length = abs(x_len) >= abs(y_len) ? abs(x_len) : abs(y_len);
+// Rounding an intersection can land it a pixel past the neighbouring edge,
+// pull it back so the clip loop cannot bounce between two edges
+static int snap_to_range(int value, int min, int max) {
+    if (value == min - 1) return min;
+    if (value == max + 1) return max;
+    return value;
+}
 
-    float dx = x_len / (float)longer_side_length;
-    float dy = y_len / (float)longer_side_length;
+// Cohen-Sutherland: clip the segment to the scissor, false when it misses
+static bool clip_line_to_scissor(int* x0, int* y0, int* x1, int* y1) {
+    int code0 = scissor_outcode(*x0, *y0);
+    int code1 = scissor_outcode(*x1, *y1);
+    while (code0 | code1) {
+        if (code0 & code1) {
+            return false;
+        }
+        int code = code0 ? code0 : code1;
+        double dx = *x1 - *x0;
+        double dy = *y1 - *y0;
+        int x, y;
+        if (code & OUTCODE_TOP) {
+            y = scissor.y0;
+            x = snap_to_range(lround(*x0 + dx * (y - *y0) / dy), scissor.x0, scissor.x1);
+        } else if (code & OUTCODE_BOTTOM) {
+            y = scissor.y1;
+            x = snap_to_range(lround(*x0 + dx * (y - *y0) / dy), scissor.x0, scissor.x1);
+        } else if (code & OUTCODE_LEFT) {
+            x = scissor.x0;
+            y = snap_to_range(lround(*y0 + dy * (x - *x0) / dx), scissor.y0, scissor.y1);
+        } else {
+            x = scissor.x1;
+            y = snap_to_range(lround(*y0 + dy * (x - *x0) / dx), scissor.y0, scissor.y1);
+        }
+        if (code == code0) {
+            *x0 = x;
+            *y0 = y;
+            code0 = scissor_outcode(x, y);
+        } else {
+            *x1 = x;
+            *y1 = y;
+            code1 = scissor_outcode(x, y);
+        }
+    }
+    return true;
+}
 
-    float x = x0;
-    float y = y0;
-    for (int i = 0; i <= longer_side_length; i++) {
-        draw_pixel(round(x), round(y), color);
-        x += dx;
-        y += dy;
+// Bresenham's integer line, clipped up front so the loop writes the rows
+// without per pixel checks
+void draw_line(int x0, int y0, int x1, int y1, uint32_t color) {
+    if (!clip_line_to_scissor(&x0, &y0, &x1, &y1)) {
+        return;
+    }
+    prepare_framebuffer_rect(
+        x0 < x1 ? x0 : x1, y0 < y1 ? y0 : y1,
+        x0 > x1 ? x0 : x1, y0 > y1 ? y0 : y1
+    );
+
+    int dx = abs(x1 - x0);
+    int dy = -abs(y1 - y0);
+    int step_x = x0 < x1 ? 1 : -1;
+    int step_y = y0 < y1 ? color_buffer_pitch : -color_buffer_pitch;
+    int length = dx > -dy ? dx : -dy;
+    int error = dx + dy;
+
+    uint32_t* pixel = color_buffer + color_buffer_pitch * y0 + x0;
+    for (int i = 0; ; i++) {
+        *pixel = color;
+        if (i == length) {
+            break;
+        }
+        int error2 = 2 * error;
+        if (error2 >= dy) {
+            error += dy;
+            pixel += step_x;
+        }
+        if (error2 <= dx) {
+            error += dx;
+            pixel += step_y;
+        }
     }
 }
 
@@ -205,10 +561,26 @@ void draw_triangle(int x0, int y0, int x1, int y1, int x2, int y2, uint32_t colo
 }
 
 void destroy_window(void) {
-	free(color_buffer);
+	if (color_buffer_locked) {
+		SDL_UnlockTexture(color_buffer_textures[present_texture_index]);
+		color_buffer_locked = false;
+	}
+	destroy_present_textures();
+	free(owned_color_buffer);
+	free(background_buffer);
+	free(color_tile_ready);
+	free(z_tile_ready);
+	owned_color_buffer = NULL;
+	background_buffer = NULL;
+	color_tile_ready = NULL;
+	z_tile_ready = NULL;
+	color_buffer = NULL;
 	free(z_buffer);
-    SDL_DestroyRenderer(renderer);
+	z_buffer = NULL;
+    if (renderer) SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
+    renderer = NULL;
+    window = NULL;
     SDL_Quit();  // destroy init
 }
 
@@ -224,7 +596,8 @@ bool should_render_wireframe(void) {
         render_method == RENDER_WIRE || 
         render_method == RENDER_WIRE_VERTEX || 
         render_method == RENDER_FILL_TRIANGLE_WIRE ||
-        render_method == RENDER_TEXTURED_WIRE
+        render_method == RENDER_TEXTURED_WIRE ||
+        render_method == RENDER_GOURAUD_WIRE
    );
 }
 
@@ -235,21 +608,22 @@ bool should_render_filled_triangles(void) {
    );
 }
 
+bool should_render_gouraud_triangles(void) {
+    return (
+        render_method == RENDER_GOURAUD ||
+        render_method == RENDER_GOURAUD_WIRE
+   );
+}
+
 bool should_render_wire_vertex(void) {
     return render_method == RENDER_WIRE_VERTEX;
 }
 
-float get_zbuffer_at(int x, int y) {
-    // if garbage inputs, return starting value (1.0)
-    if (x < 0 || x >= window_width || y < 0 || y >= window_height) {
-        return 1.0;
-    }
-    return z_buffer[(window_width * y) + x];
+// Wireframe without fill, drawn from the mesh edge list instead of triangles
+bool should_render_wire_only(void) {
+    return render_method == RENDER_WIRE || render_method == RENDER_WIRE_VERTEX;
 }
 
-void update_zbuffer_at(int x, int y, float value) {
-    if (x < 0 || x >= window_width || y < 0 || y >= window_height) {
-        return;
-    }
-    z_buffer[(window_width * y) + x] = value;
+bool should_render_overdraw(void) {
+    return render_method == RENDER_OVERDRAW;
 }
@@ -7,7 +7,14 @@
 #define FPS 60
 #define FRAME_TARGET_TIME (1000 / FPS)
 
+// Lowest fraction of the window resolution frames may be rendered at
+#define MIN_RENDER_SCALE 0.25
+
 #define BACKGROUND_GRID_INTERVAL 25
+#define BACKGROUND_COLOR 0xFF111111
+
+// Side of the square framebuffer tiles cleared lazily (see clear_color_buffer)
+#define FRAMEBUFFER_TILE_SIZE 64
 #define RED 0xFFFF0000
 #define RED_ORANGE 0xFFFF5500
 #define ORANGE 0xFFFFA500
@@ -36,9 +43,32 @@ enum render_method {
 	RENDER_FILL_TRIANGLE_WIRE,
 	RENDER_TEXTURED,
 	RENDER_TEXTURED_WIRE,
+	RENDER_GOURAUD,
+	RENDER_GOURAUD_WIRE,
+	RENDER_OVERDRAW,	// heatmap of fragments per pixel, see overdraw.h
 	RENDER_NONE
 };
 
+// How the color buffer reaches the screen
+enum present_mode {
+	PRESENT_COPY,	// rasterize into a malloc'd buffer, SDL_UpdateTexture at present
+	PRESENT_LOCKED	// rasterize straight into the locked streaming texture
+};
+
+// Up to triple buffering of the streaming textures in PRESENT_LOCKED mode
+#define MAX_PRESENT_TEXTURES 3
+
+// Depth buffer formats. Macros rather than an enum: the rasterizer kernel
+// template tests them with #if. All but DEPTH_FLOAT are reversed (cleared to 0,
+// greater is closer), which puts the precision where 1/w changes slowly.
+#define DEPTH_FLOAT 0			// 1 - 1/w as float, cleared to 1
+#define DEPTH_FLOAT_REVERSED 1	// 1/w as float
+#define DEPTH_UNORM24 2			// z_near/w in the low 24 bits of a uint32
+#define DEPTH_UNORM16 3			// z_near/w in a uint16, half the depth bandwidth
+#define NUM_DEPTH_FORMATS 4
+
+#define DEPTH_UNORM24_MAX 0xFFFFFF
+#define DEPTH_UNORM16_MAX 0xFFFF
 
 // extern SDL_Window* window;
 // extern SDL_Renderer* renderer;
@@ -52,18 +82,35 @@ enum render_method {
 bool initialize_window(void);
 int get_window_height(void);
 int get_window_width(void);
+void set_render_scale(float scale);
+float get_render_scale(void);
 void destroy_window(void);
 
 void set_render_method(int method);
+int get_render_method(void);
+const char* get_render_method_name(int method);
 void set_cull_method(int method);
 bool is_cull_backface(void);
+void set_depth_format(int format);
+int get_depth_format(void);
+void set_depth_near(float z_near);
+void set_depth_test(bool enabled);
+void set_depth_write(bool enabled);
+bool is_depth_test_enabled(void);
+bool is_depth_write_enabled(void);
 
 bool should_render_textured_triangles(void);
 bool should_render_wireframe(void);
 bool should_render_filled_triangles(void);
+bool should_render_gouraud_triangles(void);
 bool should_render_wire_vertex(void);
+bool should_render_wire_only(void);
+bool should_render_overdraw(void);
 
+void set_background(uint32_t color);
 void draw_grid(uint32_t interval, uint32_t color);
+void prepare_framebuffer_rect(int x0, int y0, int x1, int y1);
+void resolve_color_tiles(void);
 void draw_pixel(int x, int y, uint32_t color);
 void draw_line(int x0, int y0, int x1, int y1, uint32_t color);
 void draw_rect(uint32_t x, uint32_t y, uint32_t width, uint32_t height, uint32_t color);
@@ -71,8 +118,11 @@ void draw_fill_rect(uint32_t x, uint32_t y, uint32_t width, uint32_t height, uin
 void draw_triangle(int x0, int y0, int x1, int y1, int x2, int y2, uint32_t color);
 void draw_gradient_to_black_background(uint32_t color);
 
+void set_present_mode(int mode);
+int get_present_mode(void);
+void set_present_texture_count(int count);
+
+void begin_color_buffer(void);
 void render_color_buffer(void);
-void clear_color_buffer(uint32_t color);
+void clear_color_buffer(void);
 void clear_z_buffer(void);
-float get_zbuffer_at(int x, int y);
-void update_zbuffer_at(int x, int y, float value);
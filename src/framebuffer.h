@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Direct framebuffer access for the rasterizer inner loops.
+//
+// draw_pixel and the zbuffer getters in display.c check bounds and compute
+// the pixel offset on every call. Rasterizers instead fetch the frame once per
+// triangle, clip against the scissor at setup, and then read and write whole
+// rows through the unchecked inline accessors below.
+///////////////////////////////////////////////////////////////////////////////
+
+// Inclusive pixel rectangle that drawing is limited to
+typedef struct {
+	int x0, y0;
+	int x1, y1;
+} scissor_t;
+
+typedef struct {
+	uint32_t* color;
+	void* depth;		// float, uint32_t or uint16_t per pixel, see depth_format
+	int color_pitch;	// pixels between the starts of two color rows
+	int depth_pitch;	// bytes between the starts of two depth rows
+	int depth_format;	// DEPTH_FLOAT, DEPTH_FLOAT_REVERSED, DEPTH_UNORM24 or DEPTH_UNORM16
+	float depth_scale;	// 1/w to unorm depth: z_near * the format's maximum
+	int width;
+	int height;
+	scissor_t scissor;
+} framebuffer_t;
+
+// Valid between begin_color_buffer and render_color_buffer (the color rows
+// move every frame when rendering into locked textures)
+framebuffer_t get_framebuffer(void);
+
+void set_scissor(int x0, int y0, int x1, int y1);
+void reset_scissor(void);
+
+static inline uint32_t* framebuffer_color_row(const framebuffer_t* framebuffer, int y) {
+	return framebuffer->color + (ptrdiff_t)framebuffer->color_pitch * y;
+}
+
+// Cast to the element type of the depth format
+static inline void* framebuffer_depth_row(const framebuffer_t* framebuffer, int y) {
+	return (char*)framebuffer->depth + (ptrdiff_t)framebuffer->depth_pitch * y;
+}
@@ -0,0 +1,528 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "golden.h"
+#include "upng.h"
+
+#define MAX_GOLDEN_PATH 512
+
+typedef struct {
+	unsigned char* rgb;
+	int width;
+	int height;
+	int frames;		// -1 when the file does not record it
+} reference_image_t;
+
+static int golden_mode = GOLDEN_OFF;
+static const char* golden_directory = "golden";
+static int golden_tolerance = 0;
+static int golden_max_bad_pixels = 0;
+static int golden_failures = 0;
+
+void init_golden_images(int mode, const char* directory, int tolerance, int max_bad_pixels) {
+	golden_mode = mode;
+	golden_directory = directory;
+	golden_tolerance = tolerance;
+	golden_max_bad_pixels = max_bad_pixels;
+	golden_failures = 0;
+}
+
+int get_golden_mode(void) {
+	return golden_mode;
+}
+
+int get_golden_failures(void) {
+	return golden_failures;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// PNG files
+////////////////////////////////////////////////////////////////////////////////
+// References are 8-bit RGB PNGs so the committed set stays small. Writing uses
+// one fixed-Huffman deflate block with greedy LZ77 matches, which is enough for
+// frames that are mostly flat background; reading goes through upng.
+#define PNG_WINDOW 32768
+#define PNG_MIN_MATCH 3
+#define PNG_MAX_MATCH 258
+#define PNG_HASH_SIZE 65536
+
+typedef struct {
+	unsigned char* bytes;
+	size_t length;
+	size_t capacity;
+	uint32_t bits;
+	int bit_count;
+	bool failed;
+} png_buffer_t;
+
+static const uint16_t length_base[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t length_extra[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t distance_base[30] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t distance_extra[30] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+static void png_put_byte(png_buffer_t* buffer, unsigned char byte) {
+	if (buffer->length == buffer->capacity) {
+		size_t capacity = buffer->capacity ? buffer->capacity * 2 : 65536;
+		unsigned char* bytes = realloc(buffer->bytes, capacity);
+		if (bytes == NULL) {
+			buffer->failed = true;
+			return;
+		}
+		buffer->bytes = bytes;
+		buffer->capacity = capacity;
+	}
+	buffer->bytes[buffer->length++] = byte;
+}
+
+static void png_put_u32(png_buffer_t* buffer, uint32_t value) {
+	png_put_byte(buffer, value >> 24);
+	png_put_byte(buffer, (value >> 16) & 0xFF);
+	png_put_byte(buffer, (value >> 8) & 0xFF);
+	png_put_byte(buffer, value & 0xFF);
+}
+
+// Deflate packs values from the least significant bit
+static void png_put_bits(png_buffer_t* buffer, uint32_t value, int count) {
+	buffer->bits |= value << buffer->bit_count;
+	buffer->bit_count += count;
+	while (buffer->bit_count >= 8) {
+		png_put_byte(buffer, buffer->bits & 0xFF);
+		buffer->bits >>= 8;
+		buffer->bit_count -= 8;
+	}
+}
+
+// Huffman codes go most significant bit first
+static void png_put_code(png_buffer_t* buffer, uint32_t code, int count) {
+	uint32_t reversed = 0;
+	for (int i = 0; i < count; i++) {
+		reversed = reversed << 1 | ((code >> i) & 1);
+	}
+	png_put_bits(buffer, reversed, count);
+}
+
+static void png_put_symbol(png_buffer_t* buffer, int symbol) {
+	if (symbol < 144) {
+		png_put_code(buffer, 0x30 + symbol, 8);
+	} else if (symbol < 256) {
+		png_put_code(buffer, 0x190 + symbol - 144, 9);
+	} else if (symbol < 280) {
+		png_put_code(buffer, symbol - 256, 7);
+	} else {
+		png_put_code(buffer, 0xC0 + symbol - 280, 8);
+	}
+}
+
+static void png_put_match(png_buffer_t* buffer, int length, int distance) {
+	int code = 28;
+	while (length_base[code] > length) {
+		code--;
+	}
+	png_put_symbol(buffer, 257 + code);
+	png_put_bits(buffer, length - length_base[code], length_extra[code]);
+
+	code = 29;
+	while (distance_base[code] > distance) {
+		code--;
+	}
+	png_put_code(buffer, code, 5);
+	png_put_bits(buffer, distance - distance_base[code], distance_extra[code]);
+}
+
+static uint32_t crc32_update(uint32_t crc, const unsigned char* bytes, size_t length) {
+	static uint32_t table[256];
+	if (table[1] == 0) {
+		for (uint32_t n = 0; n < 256; n++) {
+			uint32_t c = n;
+			for (int k = 0; k < 8; k++) {
+				c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+			}
+			table[n] = c;
+		}
+	}
+	for (size_t i = 0; i < length; i++) {
+		crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+	}
+	return crc;
+}
+
+static void png_put_chunk(png_buffer_t* file, const char* type, const unsigned char* data, size_t length) {
+	png_put_u32(file, (uint32_t)length);
+	size_t start = file->length;
+	for (int i = 0; i < 4; i++) {
+		png_put_byte(file, type[i]);
+	}
+	for (size_t i = 0; i < length; i++) {
+		png_put_byte(file, data[i]);
+	}
+	if (!file->failed) {
+		uint32_t crc = crc32_update(0xFFFFFFFF, file->bytes + start, length + 4);
+		png_put_u32(file, crc ^ 0xFFFFFFFF);
+	}
+}
+
+static int match_length(const unsigned char* data, size_t position, size_t candidate, size_t limit) {
+	int length = 0;
+	while (length < PNG_MAX_MATCH && position + length < limit && data[candidate + length] == data[position + length]) {
+		length++;
+	}
+	return length;
+}
+
+// zlib stream of data. upng rejects a match that ends on the last byte, so
+// that byte is always a literal.
+static void png_deflate(png_buffer_t* stream, const unsigned char* data, size_t size) {
+	int32_t* head = malloc(PNG_HASH_SIZE * sizeof(int32_t));
+	if (head == NULL) {
+		stream->failed = true;
+		return;
+	}
+	for (int i = 0; i < PNG_HASH_SIZE; i++) {
+		head[i] = -1;
+	}
+	png_put_byte(stream, 0x78);
+	png_put_byte(stream, 0x01);
+	png_put_bits(stream, 1, 1);	// final block
+	png_put_bits(stream, 1, 2);	// fixed Huffman codes
+
+	size_t limit = size > 0 ? size - 1 : 0;
+	size_t position = 0;
+	while (position < size) {
+		int best_length = 0;
+		size_t best_distance = 0;
+		if (position + PNG_MIN_MATCH <= limit) {
+			const unsigned char* p = data + position;
+			uint32_t hash = ((uint32_t)p[0] << 16 | p[1] << 8 | p[2]) * 2654435761u >> 16;
+			int32_t candidate = head[hash];
+			head[hash] = (int32_t)position;
+			// The previous byte catches runs, the hash the repeats further back
+			if (position > 0) {
+				best_length = match_length(data, position, position - 1, limit);
+				best_distance = 1;
+			}
+			if (candidate >= 0 && position - candidate <= PNG_WINDOW) {
+				int length = match_length(data, position, candidate, limit);
+				if (length > best_length) {
+					best_length = length;
+					best_distance = position - candidate;
+				}
+			}
+		}
+		if (best_length >= PNG_MIN_MATCH) {
+			png_put_match(stream, best_length, (int)best_distance);
+			position += best_length;
+		} else {
+			png_put_symbol(stream, data[position]);
+			position++;
+		}
+	}
+	png_put_symbol(stream, 256);
+	png_put_bits(stream, 0, 7);	// flush to a byte boundary
+	free(head);
+
+	uint32_t a = 1, b = 0;
+	for (size_t i = 0; i < size; i++) {
+		a = (a + data[i]) % 65521;
+		b = (b + a) % 65521;
+	}
+	png_put_u32(stream, b << 16 | a);
+}
+
+static int paeth(int a, int b, int c) {
+	int p = a + b - c;
+	int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+	return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+}
+
+// Byte i of a row as predicted by filter from the bytes left, up and up-left of it
+static int png_predict(int filter, const unsigned char* row, const unsigned char* above, size_t i) {
+	int left = i >= 3 ? row[i - 3] : 0;
+	int up = above != NULL ? above[i] : 0;
+	int up_left = i >= 3 && above != NULL ? above[i - 3] : 0;
+	switch (filter) {
+		case 1: return left;
+		case 2: return up;
+		case 3: return (left + up) / 2;
+		case 4: return paeth(left, up, up_left);
+		default: return 0;
+	}
+}
+
+// Filters every row with whichever of the five PNG filters gives the smallest
+// sum of absolute values, the usual heuristic
+static void png_filter_rows(unsigned char* filtered, const unsigned char* rgb, int width, int height) {
+	size_t row_size = (size_t)width * 3;
+	for (int y = 0; y < height; y++) {
+		const unsigned char* row = rgb + row_size * y;
+		const unsigned char* above = y > 0 ? row - row_size : NULL;
+		unsigned char* output = filtered + (row_size + 1) * y;
+		int best_filter = 0;
+		long best_cost = -1;
+		for (int filter = 0; filter < 5; filter++) {
+			long cost = 0;
+			for (size_t i = 0; i < row_size; i++) {
+				int value = (row[i] - png_predict(filter, row, above, i)) & 0xFF;
+				cost += value < 128 ? value : 256 - value;
+			}
+			if (best_cost < 0 || cost < best_cost) {
+				best_cost = cost;
+				best_filter = filter;
+			}
+		}
+		output[0] = (unsigned char)best_filter;
+		for (size_t i = 0; i < row_size; i++) {
+			output[1 + i] = (unsigned char)(row[i] - png_predict(best_filter, row, above, i));
+		}
+	}
+}
+
+// Writes 0xAARRGGBB pixels as RGB; frames goes into a "frames" text chunk when >= 0
+bool write_png(const char* path, const uint32_t* pixels, int width, int height, int pitch, int frames) {
+	size_t row_size = (size_t)width * 3;
+	unsigned char* rgb = malloc(row_size * height);
+	unsigned char* filtered = malloc((row_size + 1) * height);
+	png_buffer_t stream = { 0 };
+	png_buffer_t file = { 0 };
+	bool written = false;
+	if (rgb != NULL && filtered != NULL) {
+		for (int y = 0; y < height; y++) {
+			const uint32_t* source = pixels + (size_t)pitch * y;
+			unsigned char* row = rgb + row_size * y;
+			for (int x = 0; x < width; x++) {
+				row[x * 3 + 0] = (source[x] >> 16) & 0xFF;
+				row[x * 3 + 1] = (source[x] >> 8) & 0xFF;
+				row[x * 3 + 2] = source[x] & 0xFF;
+			}
+		}
+		png_filter_rows(filtered, rgb, width, height);
+		png_deflate(&stream, filtered, (row_size + 1) * height);
+
+		static const unsigned char signature[8] = { 137, 'P', 'N', 'G', '\r', '\n', 26, '\n' };
+		unsigned char header[13] = {
+			width >> 24, (width >> 16) & 0xFF, (width >> 8) & 0xFF, width & 0xFF,
+			height >> 24, (height >> 16) & 0xFF, (height >> 8) & 0xFF, height & 0xFF,
+			8, 2, 0, 0, 0	// 8-bit RGB, not interlaced
+		};
+		for (int i = 0; i < 8; i++) {
+			png_put_byte(&file, signature[i]);
+		}
+		png_put_chunk(&file, "IHDR", header, sizeof(header));
+		if (frames >= 0) {
+			char text[32];
+			int length = snprintf(text, sizeof(text), "frames%c%d", 0, frames);
+			png_put_chunk(&file, "tEXt", (const unsigned char*)text, length);
+		}
+		png_put_chunk(&file, "IDAT", stream.bytes, stream.length);
+		png_put_chunk(&file, "IEND", NULL, 0);
+	}
+	if (rgb != NULL && filtered != NULL && !stream.failed && !file.failed) {
+		FILE* output = fopen(path, "wb");
+		if (output != NULL) {
+			written = fwrite(file.bytes, 1, file.length, output) == file.length;
+			written = fclose(output) == 0 && written;
+		}
+	}
+	free(rgb);
+	free(filtered);
+	free(stream.bytes);
+	free(file.bytes);
+	return written;
+}
+
+static uint32_t read_u32(const unsigned char* bytes) {
+	return (uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16 | (uint32_t)bytes[2] << 8 | bytes[3];
+}
+
+// The "frames" text chunk, -1 when the file has none
+static int read_png_frames(const unsigned char* bytes, size_t size) {
+	size_t offset = 8;
+	while (offset + 12 <= size) {
+		size_t length = read_u32(bytes + offset);
+		if (length > size - offset - 12) {
+			break;
+		}
+		const unsigned char* data = bytes + offset + 8;
+		if (memcmp(bytes + offset + 4, "tEXt", 4) == 0 && length > 7 && length < 32 && memcmp(data, "frames", 7) == 0) {
+			char text[32] = { 0 };
+			memcpy(text, data + 7, length - 7);
+			return atoi(text);
+		}
+		if (memcmp(bytes + offset + 4, "IDAT", 4) == 0) {
+			break;
+		}
+		offset += length + 12;
+	}
+	return -1;
+}
+
+static bool read_png(const char* path, reference_image_t* image) {
+	memset(image, 0, sizeof(*image));
+	image->frames = -1;
+	FILE* file = fopen(path, "rb");
+	if (file == NULL) {
+		return false;
+	}
+	unsigned char* bytes = NULL;
+	long size = -1;
+	if (fseek(file, 0, SEEK_END) == 0) {
+		size = ftell(file);
+		rewind(file);
+	}
+	if (size > 0) {
+		bytes = malloc(size);
+	}
+	bool valid = bytes != NULL && fread(bytes, 1, size, file) == (size_t)size;
+	fclose(file);
+
+	upng_t* png = valid ? upng_new_from_bytes(bytes, size) : NULL;
+	valid = png != NULL && upng_decode(png) == UPNG_EOK && upng_get_format(png) == UPNG_RGB8;
+	if (valid) {
+		image->width = upng_get_width(png);
+		image->height = upng_get_height(png);
+		image->frames = read_png_frames(bytes, size);
+		size_t pixels_size = (size_t)image->width * image->height * 3;
+		image->rgb = malloc(pixels_size);
+		valid = image->rgb != NULL && upng_get_size(png) >= pixels_size;
+		if (valid) {
+			memcpy(image->rgb, upng_get_buffer(png), pixels_size);
+		}
+	}
+	if (png != NULL) {
+		upng_free(png);
+	}
+	free(bytes);
+	if (!valid) {
+		free(image->rgb);
+		image->rgb = NULL;
+	}
+	return valid;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Comparison
+////////////////////////////////////////////////////////////////////////////////
+static int channel_difference(int a, int b) {
+	return a > b ? a - b : b - a;
+}
+
+// Reference dimmed to gray, failing pixels red scaled by their difference
+static bool write_diff_image(const char* path, const reference_image_t* reference, const uint32_t* differences) {
+	int width = reference->width;
+	int height = reference->height;
+	uint32_t* pixels = malloc((size_t)width * height * sizeof(uint32_t));
+	if (pixels == NULL) {
+		return false;
+	}
+	for (int i = 0; i < width * height; i++) {
+		const unsigned char* rgb = &reference->rgb[i * 3];
+		int difference = differences[i];
+		if (difference > golden_tolerance) {
+			int red = 96 + difference * 4;
+			pixels[i] = 0xFF000000 | (uint32_t)(red > 255 ? 255 : red) << 16;
+		} else {
+			uint32_t gray = (rgb[0] * 77 + rgb[1] * 150 + rgb[2] * 29) >> 9;
+			pixels[i] = 0xFF000000 | gray << 16 | gray << 8 | gray;
+		}
+	}
+	bool written = write_png(path, pixels, width, height, width, -1);
+	free(pixels);
+	return written;
+}
+
+static void compare_to_reference(golden_result_t* result, const reference_image_t* reference, const framebuffer_t* framebuffer, uint32_t* differences) {
+	double squared_error = 0;
+	for (int y = 0; y < framebuffer->height; y++) {
+		const uint32_t* row = framebuffer_color_row(framebuffer, y);
+		for (int x = 0; x < framebuffer->width; x++) {
+			int i = y * framebuffer->width + x;
+			const unsigned char* rgb = &reference->rgb[i * 3];
+			int red = channel_difference((row[x] >> 16) & 0xFF, rgb[0]);
+			int green = channel_difference((row[x] >> 8) & 0xFF, rgb[1]);
+			int blue = channel_difference(row[x] & 0xFF, rgb[2]);
+			squared_error += red * red + green * green + blue * blue;
+
+			int difference = red > green ? red : green;
+			difference = blue > difference ? blue : difference;
+			differences[i] = difference;
+			if (difference > result->max_difference) {
+				result->max_difference = difference;
+			}
+			if (difference > golden_tolerance) {
+				result->bad_pixels++;
+			}
+		}
+	}
+	double mean_squared_error = squared_error / ((double)framebuffer->width * framebuffer->height * 3);
+	result->psnr_db = mean_squared_error > 0 ? 10 * log10(255.0 * 255.0 / mean_squared_error) : INFINITY;
+	result->passed = result->bad_pixels <= golden_max_bad_pixels;
+}
+
+// Compare the captured frame against <directory>/<name>.png, or replace the
+// reference in update mode. Frames is the number of frames rendered before the
+// capture, checked against the one recorded in the reference.
+golden_result_t check_golden_image(const char* name, const framebuffer_t* framebuffer, int frames) {
+	golden_result_t result = { false, false, 0, 0, 0 };
+	char path[MAX_GOLDEN_PATH];
+	snprintf(path, sizeof(path), "%s/%s.png", golden_directory, name);
+
+	if (golden_mode == GOLDEN_UPDATE) {
+		result.passed = write_png(path, framebuffer->color, framebuffer->width, framebuffer->height, framebuffer->color_pitch, frames);
+		result.psnr_db = INFINITY;
+		if (!result.passed) {
+			fprintf(stderr, "Golden: could not write %s\n", path);
+			golden_failures++;
+		}
+		return result;
+	}
+
+	reference_image_t reference;
+	if (!read_png(path, &reference)) {
+		fprintf(stderr, "Golden: no reference %s, create it with --golden-update\n", path);
+		result.missing = true;
+	} else if (reference.width != framebuffer->width || reference.height != framebuffer->height) {
+		fprintf(stderr, "Golden: %s is %dx%d, the frame is %dx%d\n", path,
+			reference.width, reference.height, framebuffer->width, framebuffer->height);
+		result.missing = true;
+	} else if (reference.frames >= 0 && reference.frames != frames) {
+		fprintf(stderr, "Golden: %s was captured after %d frames, this run after %d\n", path, reference.frames, frames);
+		result.missing = true;
+	} else {
+		uint32_t* differences = malloc((size_t)framebuffer->width * framebuffer->height * sizeof(uint32_t));
+		if (differences != NULL) {
+			compare_to_reference(&result, &reference, framebuffer, differences);
+		}
+		if (differences != NULL && !result.passed) {
+			snprintf(path, sizeof(path), "%s/%s.actual.png", golden_directory, name);
+			write_png(path, framebuffer->color, framebuffer->width, framebuffer->height, framebuffer->color_pitch, frames);
+			snprintf(path, sizeof(path), "%s/%s.diff.png", golden_directory, name);
+			write_diff_image(path, &reference, differences);
+		}
+		free(differences);
+	}
+	if (result.passed) {
+		// Leftovers of an earlier failure
+		snprintf(path, sizeof(path), "%s/%s.actual.png", golden_directory, name);
+		remove(path);
+		snprintf(path, sizeof(path), "%s/%s.diff.png", golden_directory, name);
+		remove(path);
+	}
+	free(reference.rgb);
+
+	if (!result.passed) {
+		golden_failures++;
+	}
+	return result;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdbool.h>
+#include "framebuffer.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// Golden image regression checks
+////////////////////////////////////////////////////////////////////////////////
+// Captured frames are compared against reference images stored as RGB PNG in
+// a directory, <dir>/<name>.png. A pixel passes when every channel is within
+// the tolerance of the reference, and an image passes when no more than
+// max_bad_pixels fail. Failing images leave <name>.actual.png and a
+// <name>.diff.png next to the reference: the reference dimmed to gray with the
+// failing pixels in red, brighter the larger the difference. In update mode
+// the captures overwrite the references instead.
+//
+// References record how many frames the benchmark ran before the capture, so
+// a run with a different frame count is reported instead of compared.
+
+enum golden_mode {
+	GOLDEN_OFF,
+	GOLDEN_COMPARE,
+	GOLDEN_UPDATE
+};
+
+typedef struct {
+	bool passed;
+	bool missing;		// no usable reference, see the printed reason
+	int bad_pixels;
+	int max_difference;	// largest channel difference, 0-255
+	double psnr_db;		// INFINITY when identical
+} golden_result_t;
+
+void init_golden_images(int mode, const char* directory, int tolerance, int max_bad_pixels);
+int get_golden_mode(void);
+int get_golden_failures(void);
+
+golden_result_t check_golden_image(const char* name, const framebuffer_t* framebuffer, int frames);
+
+bool write_png(const char* path, const uint32_t* pixels, int width, int height, int pitch, int frames);
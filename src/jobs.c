@@ -0,0 +1,344 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#include <sched.h>
+#endif
+#include <SDL2/SDL.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jobs.h"
+#include "profiler.h"
+#include "trace.h"
+
+// Trace track names, which are not copied
+static const char* worker_names[MAX_JOB_WORKERS] = {
+	"main", "worker 1", "worker 2", "worker 3", "worker 4", "worker 5", "worker 6", "worker 7",
+	"worker 8", "worker 9", "worker 10", "worker 11", "worker 12", "worker 13", "worker 14", "worker 15"
+};
+
+typedef struct {
+	const char* name;
+	job_function_t function;
+	void* data;
+	int index;
+	job_counter_t* counter;
+} job_t;
+
+// Jobs top..bottom-1 of a ring, both ends moved under the lock: the owner
+// pushes and pops at the bottom, thieves take from the top. The padding keeps
+// the locks of two deques off one cache line.
+typedef struct {
+	SDL_SpinLock lock;
+	int top;
+	int bottom;
+	job_t* jobs;
+	uint8_t padding[64];
+} job_deque_t;
+
+static job_deque_t deques[MAX_JOB_WORKERS];
+static job_deque_t background;	// taken oldest first, by pool threads only
+static SDL_Thread* threads[MAX_JOB_WORKERS];	// threads[0] is unused, worker 0 is the main thread
+static int num_workers = 1;
+static int num_pool_threads = 0;	// started, the loader included, read on the main thread only
+static SDL_TLSID worker_key = 0;	// worker + 1 on pool threads
+
+static SDL_sem* wake = NULL;		// posted for sleeping pool threads when jobs are pushed
+static SDL_atomic_t num_sleeping;
+static SDL_atomic_t quit;
+
+// Broadcast when a counter drops to zero, for waiters with nothing left to run
+static SDL_mutex* done_mutex = NULL;
+static SDL_cond* done_cond = NULL;
+
+#ifdef __linux__
+static bool pinned = false;
+static cpu_set_t allowed_cores;		// of the process before any thread was pinned
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+// Deques
+////////////////////////////////////////////////////////////////////////////////
+static bool push_job(job_deque_t* deque, job_t job) {
+	SDL_AtomicLock(&deque->lock);
+	bool pushed = deque->bottom - deque->top < JOB_DEQUE_CAPACITY;
+	if (pushed) {
+		deque->jobs[deque->bottom++ % JOB_DEQUE_CAPACITY] = job;
+	}
+	SDL_AtomicUnlock(&deque->lock);
+	return pushed;
+}
+
+// Newest job for the owner, oldest for a thief
+static bool take_job(job_deque_t* deque, bool newest, job_t* job) {
+	SDL_AtomicLock(&deque->lock);
+	bool taken = deque->top < deque->bottom;
+	if (taken) {
+		*job = deque->jobs[(newest ? --deque->bottom : deque->top++) % JOB_DEQUE_CAPACITY];
+		if (deque->top == deque->bottom) {
+			deque->top = deque->bottom = 0;
+		}
+	}
+	SDL_AtomicUnlock(&deque->lock);
+	return taken;
+}
+
+// The worker's own deque, then the other workers' from the next one on, then
+// the background queue when the worker may take from it
+static bool find_job(int worker, bool take_background, job_t* job) {
+	if (take_job(&deques[worker], true, job)) {
+		return true;
+	}
+	for (int i = 1; i < num_workers; i++) {
+		if (take_job(&deques[(worker + i) % num_workers], false, job)) {
+			return true;
+		}
+	}
+	return take_background && take_job(&background, false, job);
+}
+
+static void execute_job(job_t* job, int worker) {
+	job_counter_t* counter = job->counter;
+	TRACE_SCOPE(job->name) {
+		job->function(job->index, worker, job->data);
+	}
+	if (SDL_AtomicAdd(&counter->pending, -1) == 1) {
+		SDL_LockMutex(done_mutex);
+		SDL_CondBroadcast(done_cond);
+		SDL_UnlockMutex(done_mutex);
+	}
+}
+
+// The add is a full barrier, ordering the pushes before the read of sleepers
+static void wake_sleepers(int count) {
+	int sleeping = SDL_AtomicAdd(&num_sleeping, 0);
+	for (int i = 0; i < count && i < sleeping; i++) {
+		SDL_SemPost(wake);
+	}
+}
+
+static int get_worker_index(void) {
+	intptr_t worker = worker_key != 0 ? (intptr_t)SDL_TLSGet(worker_key) : 0;
+	return worker > 0 ? worker - 1 : 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Pool threads
+////////////////////////////////////////////////////////////////////////////////
+// Bind the calling thread to the worker-th core the process was allowed on
+static void pin_thread(int worker) {
+#ifdef __linux__
+	if (!pinned) {
+		return;
+	}
+	int num_allowed = CPU_COUNT(&allowed_cores);
+	int nth = worker % num_allowed;
+	for (int core = 0; core < CPU_SETSIZE; core++) {
+		if (CPU_ISSET(core, &allowed_cores) && nth-- == 0) {
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			CPU_SET(core, &set);
+			if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+				fprintf(stderr, "Could not pin worker %d to core %d.\n", worker, core);
+			}
+			return;
+		}
+	}
+#endif
+}
+
+// Sleeping is announced before the last look for a job, so a push either
+// sees this thread as sleeping and wakes it, or is found by the look
+static int worker_main(void* data) {
+	int worker = (int)(intptr_t)data;
+	SDL_TLSSet(worker_key, (void*)(intptr_t)(worker + 1), NULL);
+	set_profile_thread(worker);
+	if (worker < num_workers) {
+		set_trace_thread_name(worker_names[worker]);
+		pin_thread(worker);
+	} else {
+		set_trace_thread_name("loader");
+	}
+	while (!SDL_AtomicGet(&quit)) {
+		job_t job;
+		if (find_job(worker, true, &job)) {
+			execute_job(&job, worker);
+			continue;
+		}
+		SDL_AtomicAdd(&num_sleeping, 1);
+		bool found = find_job(worker, true, &job);
+		if (!found && !SDL_AtomicGet(&quit)) {
+			SDL_SemWait(wake);
+		}
+		SDL_AtomicAdd(&num_sleeping, -1);
+		if (found) {
+			execute_job(&job, worker);
+		}
+	}
+	end_trace_thread();
+	return 0;
+}
+
+// Workers including the main thread, 0 for one per core. With fewer threads
+// started than asked for, the workers without a thread only run jobs when the
+// main thread waits. Without any worker thread, a single worker or none
+// started, a loader thread is started for the background jobs alone, so loads
+// never stall the main thread.
+void start_jobs(int count, bool pin_threads) {
+	stop_jobs();
+	if (count <= 0) {
+		count = SDL_GetCPUCount();
+	}
+	if (count > MAX_JOB_WORKERS) count = MAX_JOB_WORKERS;
+	if (count < 1) count = 1;
+	if (worker_key == 0) {
+		worker_key = SDL_TLSCreate();
+	}
+#ifdef __linux__
+	pinned = pin_threads && sched_getaffinity(0, sizeof(allowed_cores), &allowed_cores) == 0;
+#else
+	if (pin_threads) {
+		fprintf(stderr, "Pinning workers is only supported on Linux.\n");
+	}
+#endif
+	pin_thread(0);
+
+	wake = SDL_CreateSemaphore(0);
+	done_mutex = SDL_CreateMutex();
+	done_cond = SDL_CreateCond();
+	if (wake == NULL || done_mutex == NULL || done_cond == NULL) {
+		fprintf(stderr, "Could not create the job system, running jobs on the main thread.\n");
+		stop_jobs();
+		return;
+	}
+	for (int i = 0; i < count; i++) {
+		deques[i].jobs = malloc(sizeof(job_t) * JOB_DEQUE_CAPACITY);
+	}
+	background.jobs = malloc(sizeof(job_t) * JOB_DEQUE_CAPACITY);
+	SDL_AtomicSet(&quit, 0);
+	SDL_AtomicSet(&num_sleeping, 0);
+
+	// Set before any thread runs, which all read it
+	num_workers = count;
+	for (int i = 1; i < count; i++) {
+		threads[i] = SDL_CreateThread(worker_main, worker_names[i], (void*)(intptr_t)i);
+		if (threads[i] != NULL) {
+			num_pool_threads++;
+		}
+	}
+	if (num_pool_threads < count - 1) {
+		fprintf(stderr, "Could only start %d of %d job threads.\n", num_pool_threads, count - 1);
+	}
+
+	// No thread runs yet, so every job runs on the main thread but the
+	// background ones. The loader is worker 1: its deque stays empty.
+	if (num_pool_threads == 0) {
+		num_workers = 1;
+		threads[1] = SDL_CreateThread(worker_main, "loader", (void*)(intptr_t)1);
+		if (threads[1] != NULL) {
+			num_pool_threads++;
+		} else {
+			fprintf(stderr, "Could not start the loader thread, loading on the main thread.\n");
+		}
+	}
+}
+
+// Every counter has to be waited on first
+void stop_jobs(void) {
+	SDL_AtomicSet(&quit, 1);
+	for (int i = 0; i < num_pool_threads; i++) {
+		SDL_SemPost(wake);
+	}
+	for (int i = 1; i < MAX_JOB_WORKERS; i++) {
+		if (threads[i] != NULL) SDL_WaitThread(threads[i], NULL);
+		threads[i] = NULL;
+	}
+	for (int i = 0; i < MAX_JOB_WORKERS; i++) {
+		free(deques[i].jobs);
+	}
+	free(background.jobs);
+	memset(deques, 0, sizeof(deques));
+	memset(&background, 0, sizeof(background));
+	if (wake) SDL_DestroySemaphore(wake);
+	if (done_cond) SDL_DestroyCond(done_cond);
+	if (done_mutex) SDL_DestroyMutex(done_mutex);
+	wake = NULL;
+	done_cond = NULL;
+	done_mutex = NULL;
+	num_workers = 1;
+	num_pool_threads = 0;
+}
+
+int get_job_worker_count(void) {
+	return num_workers;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Jobs
+////////////////////////////////////////////////////////////////////////////////
+// Push jobs 0..count-1 to the calling worker's deque. With a single worker
+// they run right away.
+void run_jobs(const char* name, int count, job_function_t function, void* data, job_counter_t* counter) {
+	int worker = get_worker_index();
+	if (num_workers == 1) {
+		TRACE_SCOPE(name) {
+			for (int i = 0; i < count; i++) {
+				function(i, worker, data);
+			}
+		}
+		return;
+	}
+	SDL_AtomicAdd(&counter->pending, count);
+	bool woken = false;
+	for (int i = 0; i < count; i++) {
+		job_t job = { name, function, data, i, counter };
+		if (!push_job(&deques[worker], job)) {
+			if (!woken) wake_sleepers(count);
+			woken = true;
+			execute_job(&job, worker);
+		}
+	}
+	if (!woken) {
+		wake_sleepers(count);
+	}
+}
+
+// Run as job 0 on a pool thread, or right away when none could be started
+void run_background_job(const char* name, job_function_t function, void* data, job_counter_t* counter) {
+	job_t job = { name, function, data, 0, counter };
+	if (num_pool_threads == 0) {
+		TRACE_SCOPE(name) {
+			function(0, get_worker_index(), data);
+		}
+		return;
+	}
+	SDL_AtomicAdd(&counter->pending, 1);
+	if (!push_job(&background, job)) {
+		execute_job(&job, get_worker_index());
+		return;
+	}
+	wake_sleepers(1);
+}
+
+// Run the calling worker's jobs, then stolen ones, until the counter is zero.
+// Background jobs are left to the pool. With nothing left to take the caller
+// sleeps until a counter drops to zero.
+void wait_for_jobs(job_counter_t* counter) {
+	int worker = get_worker_index();
+	while (SDL_AtomicGet(&counter->pending) > 0) {
+		job_t job;
+		if (find_job(worker, false, &job)) {
+			execute_job(&job, worker);
+			continue;
+		}
+		SDL_LockMutex(done_mutex);
+		if (SDL_AtomicGet(&counter->pending) > 0) {
+			SDL_CondWait(done_cond, done_mutex);
+		}
+		SDL_UnlockMutex(done_mutex);
+	}
+}
+
+bool are_jobs_done(job_counter_t* counter) {
+	return SDL_AtomicGet(&counter->pending) == 0;
+}
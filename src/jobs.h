@@ -0,0 +1,55 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// Work-stealing job system, the one pool of threads every stage shares
+////////////////////////////////////////////////////////////////////////////////
+// start_jobs() starts a thread per worker past the first. Worker 0 is the
+// main thread, so the threads and the main thread together keep each core
+// busy once, without oversubscription. Every worker has a deque. A worker
+// pushes its jobs to the bottom of its own deque and pops from there,
+// newest first. An idle worker steals the oldest job from the top of
+// another worker's deque, and otherwise sleeps until jobs are pushed.
+//
+// run_jobs() pushes a batch of jobs counted on a job counter. A job that is
+// waited on depends on the counter: wait_for_jobs() runs queued jobs on the
+// calling thread until the counter drops to zero. That is how the main thread
+// takes part in the frame's work, and how a job waits for the jobs it pushed.
+// Which worker runs a job changes from run to run. Jobs should write only to
+// their own outputs, or to their worker's, for the results to stay
+// deterministic.
+//
+// Background jobs, like asset loads, are long and not waited on every frame.
+// They go to a queue that only the pool threads take from, after every
+// deque, so waiting on frame work never gets stuck behind a load. With a
+// single worker a loader thread takes them instead, and only when no thread
+// could be started do they run right away on the caller.
+//
+// Pinned workers are bound to one core each, the i-th core the process may run
+// on (Linux only, elsewhere it is ignored).
+
+#define MAX_JOB_WORKERS 16
+
+// Jobs one worker's deque holds; a worker pushing to a full deque runs the job
+// itself
+#define JOB_DEQUE_CAPACITY 4096
+
+// Index of the job in its batch, and the worker running it
+// (0..get_job_worker_count()-1, or get_job_worker_count() on the loader thread)
+typedef void (*job_function_t)(int index, int worker, void* data);
+
+// Jobs pushed on the counter that have not finished, zero initialized
+typedef struct {
+	SDL_atomic_t pending;
+} job_counter_t;
+
+void start_jobs(int num_workers, bool pin_threads);
+void stop_jobs(void);
+int get_job_worker_count(void);
+
+void run_jobs(const char* name, int count, job_function_t function, void* data, job_counter_t* counter);
+void run_background_job(const char* name, job_function_t function, void* data, job_counter_t* counter);
+void wait_for_jobs(job_counter_t* counter);
+bool are_jobs_done(job_counter_t* counter);
@@ -0,0 +1,124 @@
+#include <SDL2/SDL.h>
+#include <stdio.h>
+#include <string.h>
+#include "loader.h"
+#include "array.h"
+#include "jobs.h"
+
+#define MAX_ASSET_PATH 256
+
+typedef struct {
+	char obj_path[MAX_ASSET_PATH];
+	char png_path[MAX_ASSET_PATH];
+	mesh_t mesh;
+	texture_t texture;
+	bool mesh_loaded;
+	bool texture_loaded;
+	job_counter_t jobs;  // ready fence: the counter's last decrement orders the writes above it
+	int state;
+} asset_load_t;
+
+static asset_load_t load;
+
+// Background jobs on the job system's threads, or on the main thread without them
+static void load_mesh(int index, int worker, void* data) {
+	asset_load_t* job = data;
+	job->mesh_loaded = load_obj_file_into(&job->mesh, job->obj_path);
+}
+
+static void load_texture(int index, int worker, void* data) {
+	asset_load_t* job = data;
+	job->texture_loaded = load_png_texture(&job->texture, job->png_path);
+}
+
+// Begin decoding an asset in the background. Returns false if a load is
+// already in flight.
+bool start_async_load(char* obj_path, char* png_path) {
+	if (load.state != LOAD_IDLE) {
+		return false;
+	}
+
+	memset(&load, 0, sizeof(load));
+	snprintf(load.obj_path, MAX_ASSET_PATH, "%s", obj_path);
+	snprintf(load.png_path, MAX_ASSET_PATH, "%s", png_path);
+	load.state = LOAD_PENDING;
+	run_background_job("load obj", load_mesh, &load, &load.jobs);
+	run_background_job("decode png", load_texture, &load, &load.jobs);
+	return true;
+}
+
+// Load an obj together with the png that sits next to it (same name, .png)
+bool start_async_asset_load(char* obj_path) {
+	char png_path[MAX_ASSET_PATH];
+	snprintf(png_path, MAX_ASSET_PATH, "%s", obj_path);
+	char* extension = strrchr(png_path, '.');
+	if (extension != NULL && (size_t)(extension - png_path) + 5 <= MAX_ASSET_PATH) {
+		strcpy(extension, ".png");
+	}
+	return start_async_load(obj_path, png_path);
+}
+
+// Called once per frame from the main thread. When both halves of the asset are
+// decoded they are swapped in and the previous data is released. Returns true
+// on the frame the new asset becomes visible.
+bool poll_async_load(void) {
+	if (load.state != LOAD_PENDING || !are_jobs_done(&load.jobs)) {
+		return false;
+	}
+
+	bool swapped = false;
+	if (load.mesh_loaded && array_length(load.mesh.faces) > 0) {
+		free_mesh_data(&mesh);
+		mesh.vertices = load.mesh.vertices;
+		mesh.normals = load.mesh.normals;
+		mesh.faces = load.mesh.faces;
+		mesh.materials = load.mesh.materials;
+		mesh.edges = load.mesh.edges;
+		mesh.face_edges = load.mesh.face_edges;
+		mesh.meshlets = load.mesh.meshlets;
+		mesh.meshlet_faces = load.mesh.meshlet_faces;
+		mesh.lods = load.mesh.lods;
+		mesh.center = load.mesh.center;
+		mesh.radius = load.mesh.radius;
+		swapped = true;
+	} else {
+		fprintf(stderr, "Keeping previous mesh, could not load %s.\n", load.obj_path);
+		free_mesh_data(&load.mesh);
+	}
+
+	if (load.texture_loaded) {
+		texture_t previous = get_mesh_texture();
+		set_mesh_texture(load.texture);
+		free_texture(&previous);
+	} else {
+		fprintf(stderr, "Keeping previous texture, could not load %s.\n", load.png_path);
+	}
+
+	load.state = LOAD_IDLE;
+	return swapped;
+}
+
+// Block until the in-flight load (if any) has been swapped in. Returns true
+// when a new mesh was swapped in.
+bool wait_async_load(void) {
+	if (load.state != LOAD_PENDING) {
+		return false;
+	}
+	wait_for_jobs(&load.jobs);
+	return poll_async_load();
+}
+
+int get_async_load_state(void) {
+	return load.state;
+}
+
+// Drop an in-flight load on shutdown, discarding whatever was decoded
+void cancel_async_load(void) {
+	if (load.state != LOAD_PENDING) {
+		return;
+	}
+	wait_for_jobs(&load.jobs);
+	free_mesh_data(&load.mesh);
+	free_texture(&load.texture);
+	load.state = LOAD_IDLE;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdbool.h>
+#include "mesh.h"
+#include "texture.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// Asynchronous asset loading
+////////////////////////////////////////////////////////////////////////////////
+// The obj and png of an asset are decoded as two background jobs (see jobs.h)
+// into a private mesh_t/texture_t. Once both are done the main thread swaps
+// the result into `mesh`/`mesh_texture` between frames, so the renderer only
+// ever sees a complete asset.
+
+enum load_state {
+	LOAD_IDLE,
+	LOAD_PENDING
+};
+
+bool start_async_load(char* obj_path, char* png_path);
+bool start_async_asset_load(char* obj_path);
+bool poll_async_load(void);
+bool wait_async_load(void);
+int get_async_load_state(void);
+void cancel_async_load(void);
@@ -1,5 +1,7 @@
 #include <SDL2/SDL.h>
+#include <math.h>
 #include <stdbool.h>
+#include <string.h>
 #include <stdint.h>  // new types: the t in "uint32_t"
 
 #include "clipping.h"
@@ -12,24 +14,131 @@
 #include "triangle.h"
 #include "texture.h"
 #include "camera.h"
+#include "loader.h"
+#include "resolution.h"
+#include "timing.h"
+#include "profiler.h"
+#include "trace.h"
+#include "benchmark.h"
+#include "golden.h"
+#include "overdraw.h"
+#include "visibility.h"
+#include "scene.h"
+#include "jobs.h"
 
 #define M_PI 3.14159265358979323846
 
 #define CAMERA_Z_OFFSET 5
 
+// Fixed simulation steps per second, independent of the frame rate
+#define SIMULATION_RATE 60
+
 ////////////////////////////////////////////////////////////////////////////////
-// Array of triangles to be rendered each frame
+// Triangles to be rendered each frame, from every object of the scene, in a
+// scratch dynamic array that grows to the largest frame
 ////////////////////////////////////////////////////////////////////////////////
-#define MAX_TRIANGLES_PER_MESH 10000
-triangle_t triangles_to_render[MAX_TRIANGLES_PER_MESH];
+triangle_t* triangles_to_render = NULL;
 int num_triangles_to_render = 0;
 
+// Draw order of triangles_to_render, binned by material (see set_draw_order)
+int* triangle_order = NULL;
+
+////////////////////////////////////////////////////////////////////////////////
+// Geometry chunks: runs of meshlets of one object, built in parallel as jobs
+// (see jobs.h). A worker appends the triangles of every chunk it takes to its
+// own buffer, then the chunks are copied into triangles_to_render in chunk
+// order, so the frame is the same whichever worker built what.
+////////////////////////////////////////////////////////////////////////////////
+#define GEOMETRY_CHUNK_FACES 1024
+
+typedef struct {
+	const scene_object_t* object;
+	mesh_lod_t lod;
+	int first_meshlet;
+	int num_meshlets;
+	int worker;				// whose buffer holds the chunk's triangles
+	int worker_first;		// first triangle in that buffer
+	int first_triangle;		// in triangles_to_render
+	int num_triangles;
+} geometry_chunk_t;
+
+typedef struct {
+	triangle_t* triangles;	// scratch dynamic array
+	int num_triangles;
+} triangle_buffer_t;
+
+static geometry_chunk_t* geometry_chunks = NULL;
+static int num_geometry_chunks = 0;
+static int num_faces_in = 0;	// of the levels drawn this frame, for the benchmark
+static triangle_buffer_t worker_triangles[MAX_JOB_WORKERS];
+
+////////////////////////////////////////////////////////////////////////////////
+// Wireframe lines and vertex points to be rendered each frame, built from the
+// mesh edge list in the wire only render methods
+////////////////////////////////////////////////////////////////////////////////
+typedef struct {
+	int x0, y0;
+	int x1, y1;
+} line_t;
+
+// Scratch dynamic arrays, grown with array_hold and reused every frame
+line_t* lines_to_render = NULL;
+int num_lines_to_render = 0;
+vec2_t* points_to_render = NULL;
+int num_points_to_render = 0;
+static vec3_t* view_vertices = NULL;
+static bool* edge_visible = NULL;
+static bool* vertex_visible = NULL;
+
 ////////////////////////////////////////////////////////////////////////////////
 // Global var for exec status and game loop
 ////////////////////////////////////////////////////////////////////////////////
 bool is_running = false;
 float delta_time = 0.0;
-int previous_frame_time = 0;
+Uint64 frame_start_time = 0;	// after the frame cap sleep, for the frame's CPU time
+
+// Frame pacing, set from the command line
+static int frame_pacing = PACING_CAPPED;
+static int target_fps = FPS;
+
+// Profiling: the stats overlay (I key), and headless runs that print the stats
+// instead and stop after max_frames (0 = run until quit)
+static bool show_profile_overlay = false;
+static bool headless = false;
+static int max_frames = 0;
+static uint64_t frame_profile_start = 0;
+
+// Timeline trace written on exit and with the T key, see trace.h
+static bool trace_on_start = false;
+static char* trace_path = "trace.json";
+
+// Benchmark suite over the bundled assets, see benchmark.h (NULL = off)
+static char* benchmark_prefix = NULL;
+static int benchmark_frames = 300;
+
+// Golden image checks of the benchmark suite's frames, see golden.h
+static int golden_mode = GOLDEN_OFF;
+static char* golden_directory = "golden";
+static int golden_tolerance = 0;
+static int golden_max_bad_pixels = 0;
+
+// Scene file loaded instead of the default scene, one object of the asset
+static char* scene_path = NULL;
+
+// Job system workers, main thread included, 0 for one per core, optionally
+// pinned to a core each
+static int num_threads = 0;
+static bool pin_threads = false;
+
+// Dynamic resolution, set from the command line
+static bool dynamic_resolution = true;
+static float min_render_scale = 0.5;
+
+// Level of detail drawn (K key), LOD_AUTO picks the coarsest level whose
+// simplification error stays under LOD_PIXEL_ERROR pixels on screen
+#define LOD_AUTO -1
+#define LOD_PIXEL_ERROR 1.0
+static int lod_setting = LOD_AUTO;
 
 ///////////////////////////////////////////////////////////////////////////////
 // Declaration of our global transformation matrices
@@ -38,13 +147,36 @@ mat4_t world_matrix;
 mat4_t proj_matrix;
 mat4_t view_matrix;
 
+////////////////////////////////////////////////////////////////////////////////
+// Bundled assets, cycled at runtime with the L key
+////////////////////////////////////////////////////////////////////////////////
+static char* asset_paths[] = {
+	"./assets/cube.obj",
+	"./assets/f22.obj",
+	"./assets/f117.obj",
+	"./assets/efa.obj",
+	"./assets/crab.obj",
+	"./assets/drone.obj",
+	"./assets/sphere.obj"
+};
+#define NUM_ASSETS (int)(sizeof(asset_paths) / sizeof(asset_paths[0]))
+static int asset_index = 0;
+
 ////////////////////////////////////////////////////////////////////////////////
 // Initialize vars and objects
 ////////////////////////////////////////////////////////////////////////////////
 void setup(char* object_path) {
 	is_running = initialize_window();
+	if (!is_running) {
+		return;
+	}
+	set_background(BACKGROUND_COLOR);
+	draw_grid(BACKGROUND_GRID_INTERVAL, LIGHT_TEAL);
+	init_resolution_scaling(target_fps > 0 ? 1000.0 / target_fps : FRAME_TARGET_TIME, min_render_scale, 1.0);
+	set_resolution_scaling(dynamic_resolution);
 	set_render_method(RENDER_WIRE);
 	set_cull_method(CULL_BACKFACE);
+	start_jobs(num_threads, pin_threads);
 
 	// Initialize the scene light direction
 	init_light(vec3_new(0,0,1));
@@ -60,24 +192,26 @@ void setup(char* object_path) {
 	float z_near = 0.1;
 	float z_far = 100.0;
 	proj_matrix = mat4_make_perspective(fov_y, aspect_y, z_near, z_far);
+	set_depth_near(z_near);
 
 	// Initialize frustrum planes with point and normal each
 	init_frustrum_planes(fov_x, fov_y, z_near, z_far);
 
-	// Manually load hardcoded texture data from the static array
-	// mesh_texture = (uint32_t*)REDBRICK_TEXTURE;
-	// texture_width = 64;
-	// texture_height = 64;
+	// Render the builtin cube with the static brick texture as a placeholder
+	// while the requested asset decodes in background jobs
+	load_cube_mesh_data();
+	set_mesh_texture(get_placeholder_texture());
 
-	// Loads the vertex and face values for the mesh data structure
-	// load_obj_file_data(object_path);
-	// load_obj_file_data("./assets/f117.obj");
-	load_obj_file_data("./assets/cube.obj");
-	// load_cube_mesh_data(); // defined locally
+	// The asset spinning in front of the camera, unless a scene file is given
+	// (the benchmark suite measures the asset alone)
+	if (scene_path == NULL || benchmark_prefix != NULL || !load_scene_file(scene_path)) {
+		init_default_scene(vec3_new(0, 0, CAMERA_Z_OFFSET), vec3_new(1.5, 1.0, 0));
+	}
+
+	// Loads the obj and its png in the background, swapped in by update()
+	start_async_asset_load(object_path);
 
-	// Load the texture information from an external PNG file
-	// load_png_texture_data("./assets/f117.png");
-	load_png_texture_data("./assets/cube.png");
+	init_frame_timing(frame_pacing, target_fps, SIMULATION_RATE);
 }
 
 void process_input(void) {
@@ -123,6 +257,79 @@ void process_input(void) {
 				set_render_method( RENDER_TEXTURED_WIRE ); 
 				break;
 			}
+			if (event.key.keysym.sym == SDLK_7) {
+				set_render_method( RENDER_GOURAUD ); 
+				break;
+			}
+			if (event.key.keysym.sym == SDLK_8) {
+				set_render_method( RENDER_GOURAUD_WIRE ); 
+				break;
+			}
+			if (event.key.keysym.sym == SDLK_z) {
+				set_depth_test(!is_depth_test_enabled());
+				break;
+			}
+			if (event.key.keysym.sym == SDLK_b) {
+				set_depth_write(!is_depth_write_enabled());
+				break;
+			}
+			if (event.key.keysym.sym == SDLK_m) {
+				set_present_mode(get_present_mode() == PRESENT_LOCKED ? PRESENT_COPY : PRESENT_LOCKED);
+				break;
+			}
+			if (event.key.keysym.sym == SDLK_g) {
+				set_resolution_scaling(!is_resolution_scaling_enabled());
+				break;
+			}
+			if (event.key.keysym.sym == SDLK_l) {
+				// Keeps rendering the current asset until the next one is ready
+				if (get_async_load_state() == LOAD_IDLE) {
+					asset_index = (asset_index + 1) % NUM_ASSETS;
+					start_async_asset_load(asset_paths[asset_index]);
+				}
+				break;
+			}
+			if (event.key.keysym.sym == SDLK_i) {
+				show_profile_overlay = !show_profile_overlay;
+				set_profiling(show_profile_overlay || headless);
+				break;
+			}
+			if (event.key.keysym.sym == SDLK_t) {
+				// First press starts recording, later ones dump what was recorded
+				if (is_tracing_enabled()) {
+					if (write_trace_file(trace_path)) printf("Wrote trace %s\n", trace_path);
+				} else {
+					set_tracing(true);
+				}
+				break;
+			}
+			if (event.key.keysym.sym == SDLK_o) {
+				set_draw_order(get_draw_order() == DRAW_ORDER_MATERIAL ? DRAW_ORDER_FRONT_TO_BACK : DRAW_ORDER_MATERIAL);
+				break;
+			}
+			if (event.key.keysym.sym == SDLK_v) {
+				set_visibility_buffer(!is_visibility_buffer_enabled());
+				break;
+			}
+			if (event.key.keysym.sym == SDLK_k) {
+				// Cycle automatic, then every level from the full mesh down
+				lod_setting = lod_setting + 1 < get_mesh_lod_count(&mesh) ? lod_setting + 1 : LOD_AUTO;
+				break;
+			}
+			if (event.key.keysym.sym == SDLK_p) {
+				// Cycle perspective correction: every pixel, every 8, every 16
+				int subdivision = get_texture_subdivision();
+				set_texture_subdivision(subdivision == TEXTURE_SUBDIVISION_EXACT ? 8 : subdivision == 8 ? 16 : TEXTURE_SUBDIVISION_EXACT);
+				break;
+			}
+			if (event.key.keysym.sym == SDLK_9) {
+				// Again to switch the heatmap between shaded and tested fragments
+				if (get_render_method() == RENDER_OVERDRAW) {
+					set_overdraw_view(get_overdraw_view() == OVERDRAW_SHADED ? OVERDRAW_TESTED : OVERDRAW_SHADED);
+				}
+				set_render_method(RENDER_OVERDRAW);
+				break;
+			}
 			if (event.key.keysym.sym == SDLK_0) {
 				set_render_method( RENDER_NONE );
 				break;
@@ -180,298 +387,820 @@ int period = 4000; // 4000ms
 int accum_t = 0.0; // accumulated ms up till period
 float period_proportion = 0.0; // position relative to period
 
-void update(void) {
-	process_input();
-	int time_to_wait = FRAME_TARGET_TIME - (SDL_GetTicks() - previous_frame_time);
-	if (time_to_wait > 0 && time_to_wait <= FRAME_TARGET_TIME) {
-		SDL_Delay(time_to_wait);
-	}
-
-	delta_time = (SDL_GetTicks() - previous_frame_time) / 1000.0;
+// Advance the animation by one fixed step of dt seconds
+void simulate(float dt) {
+	animate_scene(dt);
+}
 
-	previous_frame_time = SDL_GetTicks();
+// Restart the animation and its clock, so every benchmark run sees the same frames
+static void reset_simulation(void) {
+	reset_scene_animation();
+	init_frame_timing(frame_pacing, target_fps, SIMULATION_RATE);
+}
 
-	// Initialize the counter of triangles to render for current rame
-	num_triangles_to_render = 0;
+// Face normal in view space, clockwise winding (left-handed)
+static vec3_t face_normal(vec3_t vector_a, vec3_t vector_b, vec3_t vector_c) {
+	vec3_t vector_ab = vec3_sub(vector_b, vector_a);
+	vec3_t vector_ac = vec3_sub(vector_c, vector_a);
+	vec3_normalize(&vector_ab);
+	vec3_normalize(&vector_ac);
+	vec3_t normal = vec3_cross(vector_ab, vector_ac);
+	vec3_normalize(&normal);
+	return normal;
+}
 
-	// todo: angle q that goes from 0 - 2pi over 4 seconds, to be used for setting transformation deltas
-	// accum_t = (accum_t + FRAME_TARGET_TIME) % period;
-	// period_proportion = (float)accum_t / period;
+// Faces pointing away from the camera, culled in CULL_BACKFACE. In view space
+// the camera sits at the origin, so the ray to it from a vertex is -vertex.
+static bool is_backface(vec3_t normal, vec3_t vector_a) {
+	vec3_t camera_ray = vec3_sub(vec3_new(0, 0, 0), vector_a);
+	return vec3_dot(normal, camera_ray) < 0;
+}
 
-	// mesh.scale.x += 0.01;
-	// mesh.scale.y += 0.001;
-	// mesh.scale.z += 0.001;
+// Project a view space point to screen pixels, keeping z and w
+static vec4_t project_to_screen(vec4_t point) {
+	vec4_t projected = mat4_mul_vec4_project(proj_matrix, point);
 
-	// mesh.scale.x = 1 + 0.5 * sin(angle_total_sweep * period_proportion*2);
-	// mesh.scale.y = 1 + 0.5 * sin(angle_total_sweep * period_proportion*2);
-	// mesh.scale.z = 1 + 0.5 * sin(angle_total_sweep * period_proportion*2);
+	// Invert y values since window y-coordinate axis is inverted compared to obj file y-axis
+	projected.y *= -1;
 
-	mesh.rotation.x += .025;
-	mesh.rotation.y += 1.0 * delta_time;
-	/* mesh.rotation.z += .05; */
+	// Scale into view
+	projected.x *= (get_window_width() / 2.0);
+	projected.y *= (get_window_height() / 2.0);
 
-	// mesh.translation.x = 2 * sin(angle_total_sweep * period_proportion);
-	// mesh.translation.y = 2 * cos(angle_total_sweep * period_proportion);
+	//Translate projected points to middle of screen
+	projected.x += (get_window_width() / 2.0);
+	projected.y += (get_window_height() / 2.0);
+	return projected;
+}
 
-	// Translate vertex away from camera
-	mesh.translation.z = CAMERA_Z_OFFSET;
+// Scale of an object's world matrix when it is uniform, 0 when it is not and
+// meshlet bounds cannot be trusted
+static float meshlet_cull_scale(const scene_object_t* object) {
+	if (object->scale.x != object->scale.y || object->scale.x != object->scale.z) {
+		return 0;
+	}
+	return fabsf(object->scale.x);
+}
 
-	// Offset cam pos in dir where cam is pointing at
-	// target = vec3_add(get_camera_position(), get_camera_direction());
-	vec3_t target = get_camera_lookat_target();
-	vec3_t up_direction = vec3_new(0, 1, 0);
+// Level to draw: the coarsest one whose error, scaled by the projection at
+// the near side of the bounding sphere (center in view space), stays under
+// LOD_PIXEL_ERROR
+static int select_mesh_lod(mesh_t* source, vec3_t center, float scale) {
+	int num_levels = get_mesh_lod_count(source);
+	if (lod_setting != LOD_AUTO) {
+		return lod_setting < num_levels ? lod_setting : num_levels - 1;
+	}
+	float distance = center.z - source->radius * scale;
+	if (distance <= 0) {
+		return 0;
+	}
+	float pixels_per_unit = proj_matrix.m[1][1] * get_window_height() / 2.0 / distance;
+	int level = 0;
+	for (int i = 1; i < num_levels; i++) {
+		if (get_mesh_lod(source, i).error * scale * pixels_per_unit <= LOD_PIXEL_ERROR) level = i;
+	}
+	return level;
+}
 
-	// Create the view matrix
-	view_matrix = mat4_look_at(get_camera_position(), target, up_direction);
+// Wireframe from the unique edges: every vertex is transformed once, and an
+// edge shared by two faces is drawn once if either face is visible. Appends
+// to the frame's lines and points.
+static void build_wire_edges(const scene_object_t* object, mesh_lod_t* lod) {
+	mesh_t* source = get_scene_model_mesh(object->model);
+	mat4_t world_matrix = object->world_matrix;
+	int num_vertices = array_length(source->vertices);
+	int num_edges = array_length(lod->edges);
+
+	view_vertices = array_reserve(view_vertices, num_vertices, sizeof(vec3_t));
+	vertex_visible = array_reserve(vertex_visible, num_vertices, sizeof(bool));
+	edge_visible = array_reserve(edge_visible, num_edges, sizeof(bool));
+	lines_to_render = array_reserve(lines_to_render, num_lines_to_render + num_edges, sizeof(line_t));
+	points_to_render = array_reserve(points_to_render, num_points_to_render + num_vertices, sizeof(vec2_t));
+	if (num_edges == 0) {
+		return;
+	}
+	memset(vertex_visible, 0, sizeof(bool) * num_vertices);
+	memset(edge_visible, 0, sizeof(bool) * num_edges);
 
-	mat4_t scale_matrix = mat4_make_scale(mesh.scale.x, mesh.scale.y, mesh.scale.z);
-	mat4_t translation_matrix = mat4_make_translation(mesh.translation.x, mesh.translation.y, mesh.translation.z);
-	mat4_t rotation_matrix_x = mat4_make_rotation_x(mesh.rotation.x);
-	mat4_t rotation_matrix_y = mat4_make_rotation_y(mesh.rotation.y);
-	mat4_t rotation_matrix_z = mat4_make_rotation_z(mesh.rotation.z);
+	uint64_t stage_start = profile_begin();
+	for (int i = 0; i < num_vertices; i++) {
+		vec4_t transformed_vertex = mat4_mul_vec4(world_matrix, vec4_from_vec3(source->vertices[i]));
+		view_vertices[i] = vec3_from_vec4(mat4_mul_vec4(view_matrix, transformed_vertex));
+	}
 
+	// Edges of rejected meshlets would be culled or clipped away anyway, unless
+	// a face of another meshlet shares them
+	mat4_t model_view = mat4_mul_mat4(view_matrix, world_matrix);
+	float scale = meshlet_cull_scale(object);
+	int num_meshlets = array_length(lod->meshlets);
+	for (int m = 0; m < num_meshlets; m++) {
+		meshlet_t* meshlet = &lod->meshlets[m];
+		if (scale > 0) {
+			int visibility = classify_meshlet(meshlet, model_view, scale, is_cull_backface());
+			if (visibility != MESHLET_VISIBLE) {
+				profile_count(COUNTER_MESHLETS_CULLED, 1);
+				profile_count(visibility == MESHLET_BACKFACING ? COUNTER_TRIANGLES_CULLED : COUNTER_TRIANGLES_CLIPPED, meshlet->num_faces);
+				continue;
+			}
+		}
+		for (int k = 0; k < meshlet->num_faces; k++) {
+			int i = lod->meshlet_faces[meshlet->first_face + k];
+			int* face_edges = &lod->face_edges[i * 3];
+			if (face_edges[0] < 0 || face_edges[1] < 0 || face_edges[2] < 0) {
+				continue;
+			}
+			if (is_cull_backface()) {
+				vec3_t vector_a = view_vertices[lod->faces[i].a - 1];
+				vec3_t vector_b = view_vertices[lod->faces[i].b - 1];
+				vec3_t vector_c = view_vertices[lod->faces[i].c - 1];
+				if (is_backface(face_normal(vector_a, vector_b, vector_c), vector_a)) {
+					profile_count(COUNTER_TRIANGLES_CULLED, 1);
+					continue;
+				}
+			}
+			edge_visible[face_edges[0]] = true;
+			edge_visible[face_edges[1]] = true;
+			edge_visible[face_edges[2]] = true;
+		}
+	}
+	profile_end(PROFILE_TRANSFORM, stage_start);
+
+	for (int i = 0; i < num_edges; i++) {
+		if (!edge_visible[i]) continue;
+
+		edge_t edge = lod->edges[i];
+		vec3_t a = view_vertices[edge.a];
+		vec3_t b = view_vertices[edge.b];
+		stage_start = profile_begin();
+		bool inside = clip_line(&a, &b);
+		profile_end(PROFILE_CLIP, stage_start);
+		if (!inside) continue;
+
+		// Only endpoints the frustrum did not move are mesh vertices
+		if (vec3_length(vec3_sub(a, view_vertices[edge.a])) == 0) vertex_visible[edge.a] = true;
+		if (vec3_length(vec3_sub(b, view_vertices[edge.b])) == 0) vertex_visible[edge.b] = true;
+
+		stage_start = profile_begin();
+		vec4_t projected_a = project_to_screen(vec4_from_vec3(a));
+		vec4_t projected_b = project_to_screen(vec4_from_vec3(b));
+		line_t line = { projected_a.x, projected_a.y, projected_b.x, projected_b.y };
+		lines_to_render[num_lines_to_render++] = line;
+		profile_end(PROFILE_PROJECT, stage_start);
+	}
 
-	// loop triangle faces of mesh
-	int num_faces = array_length(mesh.faces);
-	for (int i = 0; i < num_faces; i++) {
-		face_t mesh_face = mesh.faces[i];
+	if (!should_render_wire_vertex()) {
+		return;
+	}
+	for (int i = 0; i < num_vertices; i++) {
+		if (!vertex_visible[i]) continue;
+		vec4_t projected = project_to_screen(vec4_from_vec3(view_vertices[i]));
+		points_to_render[num_points_to_render++] = vec2_new(projected.x, projected.y);
+	}
+}
 
-		vec3_t face_vertices[3];
-		face_vertices[0] = mesh.vertices[mesh_face.a - 1];
-		face_vertices[1] = mesh.vertices[mesh_face.b - 1];
-		face_vertices[2] = mesh.vertices[mesh_face.c - 1];
+// Transform, light, cull, clip and project one face of an object's model,
+// appending its triangles to output
+static void build_face_triangles(const scene_object_t* object, mesh_t* source, face_t mesh_face, triangle_buffer_t* output) {
+	uint64_t stage_start = profile_begin();
+	mat4_t world_matrix = object->world_matrix;
+
+	vec3_t face_vertices[3];
+	face_vertices[0] = source->vertices[mesh_face.a - 1];
+	face_vertices[1] = source->vertices[mesh_face.b - 1];
+	face_vertices[2] = source->vertices[mesh_face.c - 1];
+
+	int vertex_indices[3] = { mesh_face.a - 1, mesh_face.b - 1, mesh_face.c - 1 };
+	bool has_vertex_normals = array_length(source->normals) == array_length(source->vertices);
+
+	vec4_t transformed_vertices[3];
+
+	// Loop all 3 vertices of current face and apply transformations
+	for (int j = 0; j < 3; j++) {
+		vec4_t transformed_vertex = vec4_from_vec3(face_vertices[j]);
+
+		///////////// OLD
+		// Multiply by scale matrix
+		// transformed_vertex = mat4_mul_vec4(scale_matrix, transformed_vertex);
+		//
+		// // Multiply by rotation matrices
+		// transformed_vertex = mat4_mul_vec4(rotation_matrix_x, transformed_vertex);
+		// transformed_vertex = mat4_mul_vec4(rotation_matrix_y, transformed_vertex);
+		// transformed_vertex = mat4_mul_vec4(rotation_matrix_z, transformed_vertex);
+		//
+		// // Multiply by translation matrix
+		// transformed_vertex = mat4_mul_vec4(translation_matrix, transformed_vertex);
+		///////////////////////////////
+
+		//////////// NEW BUT BUG (instructor must have changed previous lessons' code that I'm unaware of)
+		transformed_vertex = mat4_mul_vec4(world_matrix, transformed_vertex);
+		transformed_vertex = mat4_mul_vec4(view_matrix, transformed_vertex);
+
+		// Store for use outside of loop
+		transformed_vertices[j] = transformed_vertex;
+	}
 
-		vec4_t transformed_vertices[3];
+	vec3_t vector_a = vec3_from_vec4(transformed_vertices[0]);
+	vec3_t vector_b = vec3_from_vec4(transformed_vertices[1]);
+	vec3_t vector_c = vec3_from_vec4(transformed_vertices[2]);
+
+	// Left-handed coordinate system: take clockwise cross
+	// Compute face normal: cross b-a x c-a
+	vec3_t normal = face_normal(vector_a, vector_b, vector_c);
+
+	// CULL BACKFACES
+	if (is_cull_backface()) {
+		// Bypass/cull faces that are away from camera
+		if (is_backface(normal, vector_a)) {
+			profile_count(COUNTER_TRIANGLES_CULLED, 1);
+			profile_end(PROFILE_TRANSFORM, stage_start);
+			return;
+		}
+	}
 
-		// Loop all 3 vertices of current face and apply transformations
+	// Per-vertex light for Gouraud shading, falls back to the face light
+	float face_shade = -vec3_dot(normal, get_light_direction());
+	float vertex_shades[3] = { face_shade, face_shade, face_shade };
+	if (has_vertex_normals && should_render_gouraud_triangles()) {
 		for (int j = 0; j < 3; j++) {
-			vec4_t transformed_vertex = vec4_from_vec3(face_vertices[j]);
-
-			// Create world matrix w/ scale, rotate, translate matrices
-			mat4_t world_matrix = mat4_identity();
-
-			// Order matters: scale, rotate, translate [T]*[R]*[S]*v
-			world_matrix = mat4_mul_mat4(scale_matrix, world_matrix);
-			world_matrix = mat4_mul_mat4(rotation_matrix_z, world_matrix);
-			world_matrix = mat4_mul_mat4(rotation_matrix_y, world_matrix);
-			world_matrix = mat4_mul_mat4(rotation_matrix_x, world_matrix);
-			world_matrix = mat4_mul_mat4(translation_matrix, world_matrix);
-
-			///////////// OLD
-			// Multiply by scale matrix
-			// transformed_vertex = mat4_mul_vec4(scale_matrix, transformed_vertex);
-			//
-			// // Multiply by rotation matrices
-			// transformed_vertex = mat4_mul_vec4(rotation_matrix_x, transformed_vertex);
-			// transformed_vertex = mat4_mul_vec4(rotation_matrix_y, transformed_vertex);
-			// transformed_vertex = mat4_mul_vec4(rotation_matrix_z, transformed_vertex);
-			//
-			// // Multiply by translation matrix
-			// transformed_vertex = mat4_mul_vec4(translation_matrix, transformed_vertex);
-			///////////////////////////////
-
-			//////////// NEW BUT BUG (instructor must have changed previous lessons' code that I'm unaware of)
-			transformed_vertex = mat4_mul_vec4(world_matrix, transformed_vertex);
-			transformed_vertex = mat4_mul_vec4(view_matrix, transformed_vertex);
-
-			// Store for use outside of loop
-			transformed_vertices[j] = transformed_vertex;
+			vec4_t vertex_normal = vec4_from_vec3(source->normals[vertex_indices[j]]);
+			vertex_normal.w = 0;
+			vertex_normal = mat4_mul_vec4(world_matrix, vertex_normal);
+			vertex_normal = mat4_mul_vec4(view_matrix, vertex_normal);
+
+			vec3_t view_normal = vec3_from_vec4(vertex_normal);
+			if (vec3_length(view_normal) > 0) {
+				vec3_normalize(&view_normal);
+			}
+			vertex_shades[j] = -vec3_dot(view_normal, get_light_direction());
 		}
+	}
+
+	profile_end(PROFILE_TRANSFORM, stage_start);
+	stage_start = profile_begin();
+
+	// Create a polygon from original transformed triangle to be clipped
+	polygon_t polygon = polygon_from_triangle(
+		vec3_from_vec4(transformed_vertices[0]), 
+		vec3_from_vec4(transformed_vertices[1]), 
+		vec3_from_vec4(transformed_vertices[2]),
+		mesh_face.a_uv,
+		mesh_face.b_uv,
+		mesh_face.c_uv,
+		vertex_shades[0],
+		vertex_shades[1],
+		vertex_shades[2]
+	);
+
+	// Clip poly and return new poly with potential new vertices
+	if (clip_polygon(&polygon)) {
+		profile_count(COUNTER_TRIANGLES_CLIPPED, 1);
+	}
 
-		vec3_t vector_a = vec3_from_vec4(transformed_vertices[0]);
-		vec3_t vector_b = vec3_from_vec4(transformed_vertices[1]);
-		vec3_t vector_c = vec3_from_vec4(transformed_vertices[2]);
+	// Break polygon apart back into triangles
+	triangle_t triangles_after_clipping[MAX_NUM_POLY_TRIANGLES];
+	int num_triangles_after_clipping = 0;
 
-		vec3_t vector_ab = vec3_sub(vector_b, vector_a);
-		vec3_t vector_ac = vec3_sub(vector_c, vector_a);
-		vec3_normalize(&vector_ab);
-		vec3_normalize(&vector_ac);
+	triangles_from_polygon(&polygon, triangles_after_clipping, &num_triangles_after_clipping);
+	profile_end(PROFILE_CLIP, stage_start);
+	stage_start = profile_begin();
 
-		// Left-handed coordinate system: take clockwise cross
-		// Compute face normal: cross b-a x c-a
-		vec3_t normal = vec3_cross(vector_ab, vector_ac);
-		vec3_normalize(&normal);
+	// Loops all assembled triangles after clipping
+	for (int t = 0; t < num_triangles_after_clipping; t++) {
+		triangle_t triangle_after_clipping = triangles_after_clipping[t];
 
-		// Find vector from a point on triangle to camera position
-		vec3_t camera_ray = vec3_sub(get_camera_position(), normal);
+		// PROJECT each point
+		vec4_t projected_points[3];
+
+		// Loop all 3 vertices to perform projection and conversion to screen space
+		for (int j = 0; j < 3; j++) {
+			projected_points[j] = project_to_screen(triangle_after_clipping.points[j]);
+		}
+
+		//////////////////////////////////////////////////////////////////////////
+		// Infinite direction lighting
+		//////////////////////////////////////////////////////////////////////////
+
+		// Calc shade intensity based on how aligned is the normal to the inverse of the light
+		float light_intensity_factor = -vec3_dot(normal, get_light_direction());
+
+		uint32_t triangle_color = mesh_face.color;
+		triangle_color = light_apply_intensity(triangle_color, light_intensity_factor);
+
+		triangle_t triangle_to_render = {
+			.points = {
+				{ projected_points[0].x , projected_points[0].y, projected_points[0].z, projected_points[0].w},
+				{ projected_points[1].x , projected_points[1].y, projected_points[1].z, projected_points[1].w},
+				{ projected_points[2].x , projected_points[2].y, projected_points[2].z, projected_points[2].w},
+			},
+			.texcoords = {
+				{ mesh_face.a_uv.u, mesh_face.a_uv.v }, 
+				{ mesh_face.b_uv.u, mesh_face.b_uv.v }, 
+				{ mesh_face.c_uv.u, mesh_face.c_uv.v },
+			},
+			.shades = {
+				triangle_after_clipping.shades[0],
+				triangle_after_clipping.shades[1],
+				triangle_after_clipping.shades[2],
+			},
+			.color = triangle_color,
+			.base_color = mesh_face.color,
+			.material = get_scene_material_slot(object->model, mesh_face.material),
+		};
+
+		// Save projected triangle in the worker's buffer
+		if (output->num_triangles >= array_length(output->triangles)) {
+			output->triangles = array_hold(output->triangles, 1, sizeof(triangle_t));
+		}
+		output->triangles[output->num_triangles++] = triangle_to_render;
+	}
+	profile_end(PROFILE_PROJECT, stage_start);
+}
 
-		// Calculate how aligned camera ray is with face normal: 
-		// 	dot product camera ray with face normal
-		float dot_normal_camera = vec3_dot(camera_ray, vector_a);
+// Reject whole meshlets of a chunk, then build the faces of the rest into
+// output. Their faces are counted as culled or clipped like faces rejected
+// one by one.
+static void build_triangles(geometry_chunk_t* chunk, triangle_buffer_t* output) {
+	const scene_object_t* object = chunk->object;
+	mesh_lod_t* lod = &chunk->lod;
+	mesh_t* source = get_scene_model_mesh(object->model);
+	mat4_t model_view = mat4_mul_mat4(view_matrix, object->world_matrix);
+	float scale = meshlet_cull_scale(object);
+	for (int m = chunk->first_meshlet; m < chunk->first_meshlet + chunk->num_meshlets; m++) {
+		meshlet_t* meshlet = &lod->meshlets[m];
+		if (scale > 0) {
+			uint64_t stage_start = profile_begin();
+			int visibility = classify_meshlet(meshlet, model_view, scale, is_cull_backface());
+			profile_end(PROFILE_TRANSFORM, stage_start);
+			if (visibility != MESHLET_VISIBLE) {
+				profile_count(COUNTER_MESHLETS_CULLED, 1);
+				profile_count(visibility == MESHLET_BACKFACING ? COUNTER_TRIANGLES_CULLED : COUNTER_TRIANGLES_CLIPPED, meshlet->num_faces);
+				continue;
+			}
+		}
+		int* faces = &lod->meshlet_faces[meshlet->first_face];
+		for (int i = 0; i < meshlet->num_faces; i++) {
+			build_face_triangles(object, source, lod->faces[faces[i]], output);
+		}
+	}
+}
 
-		// CULL BACKFACES
-		if (is_cull_backface()) {
-			// Bypass/cull faces that are away from camera
-			if (dot_normal_camera < 0) continue;
+// Split an object's meshlets into chunks of at least GEOMETRY_CHUNK_FACES faces
+static void add_geometry_chunks(const scene_object_t* object, mesh_lod_t* lod) {
+	int num_meshlets = array_length(lod->meshlets);
+	for (int m = 0; m < num_meshlets;) {
+		geometry_chunk_t chunk = { .object = object, .lod = *lod, .first_meshlet = m };
+		for (int num_faces = 0; m < num_meshlets && num_faces < GEOMETRY_CHUNK_FACES; m++) {
+			num_faces += lod->meshlets[m].num_faces;
+			chunk.num_meshlets++;
 		}
+		geometry_chunks = array_reserve(geometry_chunks, num_geometry_chunks + 1, sizeof(geometry_chunk_t));
+		geometry_chunks[num_geometry_chunks++] = chunk;
+	}
+}
 
-		// Create a polygon from original transformed triangle to be clipped
-		polygon_t polygon = polygon_from_triangle(
-			vec3_from_vec4(transformed_vertices[0]), 
-			vec3_from_vec4(transformed_vertices[1]), 
-			vec3_from_vec4(transformed_vertices[2]),
-			mesh_face.a_uv,
-			mesh_face.b_uv,
-			mesh_face.c_uv
-		);
+static void build_chunk(int index, int worker, void* data) {
+	geometry_chunk_t* chunk = &geometry_chunks[index];
+	triangle_buffer_t* output = &worker_triangles[worker];
+	chunk->worker = worker;
+	chunk->worker_first = output->num_triangles;
+	build_triangles(chunk, output);
+	chunk->num_triangles = output->num_triangles - chunk->worker_first;
+}
 
-		// Clip poly and return new poly with potential new vertices
-		clip_polygon(&polygon);
+static void gather_chunk(int index, int worker, void* data) {
+	geometry_chunk_t* chunk = &geometry_chunks[index];
+	memcpy(&triangles_to_render[chunk->first_triangle],
+		&worker_triangles[chunk->worker].triangles[chunk->worker_first],
+		sizeof(triangle_t) * chunk->num_triangles);
+}
 
-		// Break polygon apart back into triangles
-		triangle_t triangles_after_clipping[MAX_NUM_POLY_TRIANGLES];
-		int num_triangles_after_clipping = 0;
+// Build every chunk as a job, then gather their triangles in chunk order
+static void build_geometry_chunks(void) {
+	for (int i = 0; i < get_job_worker_count(); i++) {
+		worker_triangles[i].num_triangles = 0;
+	}
+	job_counter_t counter = { { 0 } };
+	run_jobs("build chunk", num_geometry_chunks, build_chunk, NULL, &counter);
+	wait_for_jobs(&counter);
 
-		triangles_from_polygon(&polygon, triangles_after_clipping, &num_triangles_after_clipping);
+	for (int i = 0; i < num_geometry_chunks; i++) {
+		geometry_chunks[i].first_triangle = num_triangles_to_render;
+		num_triangles_to_render += geometry_chunks[i].num_triangles;
+	}
+	triangles_to_render = array_reserve(triangles_to_render, num_triangles_to_render, sizeof(triangle_t));
+	run_jobs("gather chunk", num_geometry_chunks, gather_chunk, NULL, &counter);
+	wait_for_jobs(&counter);
+}
 
-		// Loops all assembled triangles after clipping
-		for (int t = 0; t < num_triangles_after_clipping; t++) {
-			triangle_t triangle_after_clipping = triangles_after_clipping[t];
+// Skip objects whose bounding sphere is outside the frustrum, then build the
+// level of detail their size on screen calls for: wire edges right away,
+// triangles as chunks left to the jobs
+static void build_object(const scene_object_t* object) {
+	mesh_t* source = get_scene_model_mesh(object->model);
+	float scale = fmaxf(fabsf(object->scale.x), fmaxf(fabsf(object->scale.y), fabsf(object->scale.z)));
+	mat4_t model_view = mat4_mul_mat4(view_matrix, object->world_matrix);
+	vec3_t center = vec3_from_vec4(mat4_mul_vec4(model_view, vec4_from_vec3(source->center)));
+	if (is_sphere_outside_frustrum(center, source->radius * scale)) {
+		profile_count(COUNTER_OBJECTS_CULLED, 1);
+		return;
+	}
 
-			// PROJECT each point
-			vec4_t projected_points[3];
+	int level = select_mesh_lod(source, center, scale);
+	mesh_lod_t lod = get_mesh_lod(source, level);
+	profile_count(COUNTER_LOD_LEVEL, level);
+	profile_count(COUNTER_TRIANGLES_IN, array_length(lod.faces));
+	num_faces_in += array_length(lod.faces);
+	if (should_render_wire_only()) {
+		build_wire_edges(object, &lod);
+	} else {
+		add_geometry_chunks(object, &lod);
+	}
+}
 
-			// Loop all 3 vertices to perform projection and conversion to screen space
-			for (int j = 0; j < 3; j++) {
-				// Project current vertex
-				// projected_points[j] = project(vec3_from_vec4(transformed_vertices[j]));
-				projected_points[j] = mat4_mul_vec4_project(proj_matrix, triangle_after_clipping.points[j]);
+void update(void) {
+	TRACE_SCOPE("frame pacing") {
+		wait_for_next_frame();
+	}
+	delta_time = get_frame_delta();
+	frame_start_time = SDL_GetPerformanceCounter();
+	frame_profile_start = profile_begin();
+
+	// Input after the wait, so it is as fresh as possible when the frame is built
+	TRACE_SCOPE("input") {
+		process_input();
+	}
 
-				// Invert y values since window y-coordinate axis is inverted compared to obj file y-axis
+	// Swap in a finished background load before building this frame's triangles
+	TRACE_SCOPE("asset swap") {
+		poll_async_load();
+	}
+
+	// The benchmark suite drives the render method and the camera
+	if (is_benchmark_running() && benchmark_begin_frame() == BENCHMARK_RUN_STARTED) {
+		reset_simulation();
+	}
 
-				projected_points[j].y *= -1;
+	// Initialize the counter of triangles to render for current rame
+	num_triangles_to_render = 0;
+	num_lines_to_render = 0;
+	num_points_to_render = 0;
 
-				// Scale into view
-				projected_points[j].x *= (get_window_width() / 2.0);
-				projected_points[j].y *= (get_window_height() / 2.0);
+	// todo: angle q that goes from 0 - 2pi over 4 seconds, to be used for setting transformation deltas
+	// accum_t = (accum_t + FRAME_TARGET_TIME) % period;
+	// period_proportion = (float)accum_t / period;
 
-				//Translate projected points to middle of screen
-				projected_points[j].x += (get_window_width() / 2.0);
-				projected_points[j].y += (get_window_height() / 2.0);
+	// mesh.scale.x += 0.01;
+	// mesh.scale.y += 0.001;
+	// mesh.scale.z += 0.001;
 
-			}
+	// mesh.scale.x = 1 + 0.5 * sin(angle_total_sweep * period_proportion*2);
+	// mesh.scale.y = 1 + 0.5 * sin(angle_total_sweep * period_proportion*2);
+	// mesh.scale.z = 1 + 0.5 * sin(angle_total_sweep * period_proportion*2);
 
-			//////////////////////////////////////////////////////////////////////////
-			// Infinite direction lighting
-			//////////////////////////////////////////////////////////////////////////
+	while (step_simulation()) {
+		simulate(get_simulation_step());
+	}
 
-			// Calc shade intensity based on how aligned is the normal to the inverse of the light
-			float light_intensity_factor = -vec3_dot(normal, get_light_direction());
+	// Render between the last two steps so motion is smooth at any frame rate,
+	// every object's world matrix computed once for all of its faces
+	update_scene_world_matrices(get_simulation_alpha());
+	update_scene_materials();
 
-			uint32_t triangle_color = mesh_face.color;
-			triangle_color = light_apply_intensity(triangle_color, light_intensity_factor);
+	// Offset cam pos in dir where cam is pointing at
+	// target = vec3_add(get_camera_position(), get_camera_direction());
+	vec3_t target = get_camera_lookat_target();
+	vec3_t up_direction = vec3_new(0, 1, 0);
 
-			triangle_t triangle_to_render = {
-				.points = {
-					{ projected_points[0].x , projected_points[0].y, projected_points[0].z, projected_points[0].w},
-					{ projected_points[1].x , projected_points[1].y, projected_points[1].z, projected_points[1].w},
-					{ projected_points[2].x , projected_points[2].y, projected_points[2].z, projected_points[2].w},
-				},
-				.texcoords = {
-					{ mesh_face.a_uv.u, mesh_face.a_uv.v }, 
-					{ mesh_face.b_uv.u, mesh_face.b_uv.v }, 
-					{ mesh_face.c_uv.u, mesh_face.c_uv.v },
-				},
-				.color = triangle_color,
-			};
+	// Create the view matrix
+	view_matrix = mat4_look_at(get_camera_position(), target, up_direction);
 
-			// Save projected triangle in array of triangles to render
-			if (num_triangles_to_render < MAX_TRIANGLES_PER_MESH) {
-				triangles_to_render[num_triangles_to_render] = triangle_to_render;
-				num_triangles_to_render++;
-			}
+	PROFILE_SCOPE(PROFILE_GEOMETRY) TRACE_SCOPE("geometry") {
+		num_geometry_chunks = 0;
+		num_faces_in = 0;
+		int num_objects = get_scene_object_count();
+		for (int i = 0; i < num_objects; i++) {
+			build_object(get_scene_object(i));
 		}
+		build_geometry_chunks();
 	}
 }
 
-
 ////////////////////////////////////////////////////////////////////////////////
 // RENDER
 ////////////////////////////////////////////////////////////////////////////////
 void render(void) {
-	clear_color_buffer(0xFF111111);
+	begin_color_buffer();
+
+	clear_color_buffer();
 	clear_z_buffer();
+	if (should_render_overdraw()) {
+		begin_overdraw_frame();
+	}
+	if (should_render_visibility_buffer()) {
+		begin_visibility_frame();
+	}
 
-	draw_grid(BACKGROUND_GRID_INTERVAL, LIGHT_TEAL);
+	// Group triangles by material so each texture is fetched from in one run,
+	// nearest first within a material when drawing front to back
+	PROFILE_SCOPE(PROFILE_SORT) TRACE_SCOPE("sort") {
+		triangle_order = array_reserve(triangle_order, num_triangles_to_render, sizeof(int));
+		sort_triangles(triangles_to_render, num_triangles_to_render, get_scene_material_count(), triangle_order);
+	}
+
+	// Rasterizer specialized for the render method and depth state, picked once per frame
+	triangle_kernel_t draw_triangle_kernel = select_triangle_kernel();
+	bool draw_vertices = should_render_wire_vertex();
+	uint64_t raster_start = profile_begin();
+	trace_begin("raster");
+
+	// Wire only methods have no triangles, just the unique edges drawn over
+	// the vertices
+	for (int i = 0; i < num_points_to_render; i++) {
+		draw_rect(points_to_render[i].x - 3, points_to_render[i].y - 3, 6, 6, PINK);
+	}
+	for (int i = 0; i < num_lines_to_render; i++) {
+		line_t line = lines_to_render[i];
+		draw_line(line.x0, line.y0, line.x1, line.y1, GREEN);
+	}
+
+	int bound_material = -1;
+	texture_t* texture = NULL;
 
 	// Loop all projected points and render them
 	for (int i = 0; i < num_triangles_to_render; i++) {
-		triangle_t triangle = triangles_to_render[i];
-		
-		int x[3], y[3];
-		float z[3], w[3];
-		tex2_t uv[3];
+		triangle_t triangle = triangles_to_render[triangle_order[i]];
 
-		for (int j = 0; j < 3; j++) {
-			x[j] = triangle.points[j].x;
-			y[j] = triangle.points[j].y;
-			z[j] = triangle.points[j].z;
-			w[j] = triangle.points[j].w;
-			uv[j] = triangle.texcoords[j];
+		// Switch texture only when the material changes (once per bin)
+		if (triangle.material != bound_material) {
+			bound_material = triangle.material;
+			texture = get_scene_material_texture(bound_material);
 		}
 
-		// Draw textured triangle
-		if (should_render_textured_triangles()) {
-			// don't actually need to pass z's
-			draw_textured_triangle(
-				x[0], y[0], z[0], w[0], uv[0].u, uv[0].v,
-				x[1], y[1], z[1], w[1], uv[1].u, uv[1].v,
-				x[2], y[2], z[2], w[2], uv[2].u, uv[2].v,
-				mesh_texture
-			);
+		if (draw_triangle_kernel != NULL) {
+			draw_triangle_kernel(&triangle, texture);
 		}
 
-		// Draw wireframe
-		if (should_render_wireframe()) {
-			draw_triangle(x[0], y[0], x[1], y[1], x[2], y[2], GREEN);
-		} 
-
-		if (should_render_filled_triangles()) {
-			// don't actually need to pass z's here either (see draw_textured_triangle)
-			draw_filled_triangle(
-				x[0],y[0],w[0],
-				x[1],y[1],w[1],
-				x[2],y[2],w[2], 
-				triangle.color
-			);
+		if (draw_vertices) {
+			for (int j = 0; j < 3; j++) {
+				draw_rect(triangle.points[j].x - 3, triangle.points[j].y - 3, 6, 6, PINK);
+			}
 		}
+	}
+	trace_end("raster");
+	profile_end(PROFILE_RASTER, raster_start);
+	if (draw_triangle_kernel != NULL) {
+		profile_count(COUNTER_TRIANGLES_DRAWN, num_triangles_to_render);
+	}
 
-		if (should_render_wire_vertex()) {
-			draw_rect(x[0] - 3, y[0] - 3, 6, 6, PINK);
-			draw_rect(x[1] - 3, y[1] - 3, 6, 6, PINK);
-			draw_rect(x[2] - 3, y[2] - 3, 6, 6, PINK);
+	// Deferred texturing
+	if (should_render_visibility_buffer()) {
+		PROFILE_SCOPE(PROFILE_RESOLVE) TRACE_SCOPE("resolve") {
+			resolve_visibility();
 		}
 	}
-	
-	render_color_buffer();
+	if (should_render_overdraw()) {
+		resolve_overdraw();
+	}
+
+	// Edges of the filled methods in a pass of their own over every fill, so
+	// no triangle drawn later covers them
+	if (should_render_wireframe()) {
+		PROFILE_SCOPE(PROFILE_RASTER) TRACE_SCOPE("wireframe") {
+			for (int i = 0; i < num_triangles_to_render; i++) {
+				triangle_t* triangle = &triangles_to_render[triangle_order[i]];
+				draw_triangle(
+					triangle->points[0].x, triangle->points[0].y,
+					triangle->points[1].x, triangle->points[1].y,
+					triangle->points[2].x, triangle->points[2].y,
+					GREEN
+				);
+			}
+		}
+	}
+
+	// Captured before the overlays, which would differ on every run
+	if (is_benchmark_capture_frame()) {
+		// Tiles nothing was drawn into still hold an older frame until restored
+		resolve_color_tiles();
+		framebuffer_t framebuffer = get_framebuffer();
+		capture_benchmark_frame(&framebuffer);
+	}
+
+	if (show_profile_overlay) {
+		draw_profile_overlay();
+	}
+	if (should_render_overdraw()) {
+		draw_overdraw_overlay();
+	}
+
+	PROFILE_SCOPE(PROFILE_PRESENT) TRACE_SCOPE("render_color_buffer") {
+		render_color_buffer();
+	}
+
+	// Pick the resolution of the next frame from this frame's cost
+	Uint64 frame_time = SDL_GetPerformanceCounter() - frame_start_time;
+	float frame_ms = frame_time * 1000.0 / SDL_GetPerformanceFrequency();
+	set_render_scale(update_resolution_scale(frame_ms));
+
+	profile_end(PROFILE_FRAME, frame_profile_start);
+	end_profile_frame();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 // Free memory that was dyn alloc
 ////////////////////////////////////////////////////////////////////////////////
 void free_resources() {
-	upng_free(png_texture);
-	array_free(mesh.faces);
-	array_free(mesh.vertices);
+	cancel_async_load();
+	stop_jobs();
+	texture_t texture = get_mesh_texture();
+	free_texture(&texture);
+	free_mesh_data(&mesh);
+	free_scene();
+	array_free(triangles_to_render);
+	array_free(triangle_order);
+	array_free(geometry_chunks);
+	for (int i = 0; i < MAX_JOB_WORKERS; i++) {
+		array_free(worker_triangles[i].triangles);
+	}
+	array_free(lines_to_render);
+	array_free(points_to_render);
+	array_free(view_vertices);
+	array_free(edge_visible);
+	array_free(vertex_visible);
+	free_overdraw_buffer();
+	free_triangle_sort_buffers();
+	free_visibility_buffers();
+}
+
+// Every asset and render method headless, tables to PREFIX.csv and PREFIX.json
+static void enable_benchmark_suite(char* prefix) {
+	benchmark_prefix = prefix;
+	headless = true;
+	frame_pacing = PACING_BENCHMARK;
+	dynamic_resolution = false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Command line: [--present=copy|locked] [--depth=float|reversed|24|16]
+//               [--dynres=on|off]
+//               [--dynres-min=SCALE] [--sort=material|front-to-back]
+//               [--visibility=on|off] [--lod=auto|LEVEL] [--scene=FILE]
+//               [--threads=N] [--pin-threads]
+//               [--fps=N] [--uncapped] [--benchmark]
+//               [--profile] [--headless] [--frames=N] [--trace[=FILE]]
+//               [--bench-suite[=PREFIX]] [--bench-frames=N]
+//               [--golden[=DIR]] [--golden-update[=DIR]]
+//               [--golden-tolerance=N] [--golden-max-bad=N] [obj path]
+////////////////////////////////////////////////////////////////////////////////
+static bool parse_arguments(int argc, char* argv[], char** object_path) {
+	for (int i = 1; i < argc; i++) {
+		char* arg = argv[i];
+		if (strcmp(arg, "--present=copy") == 0) {
+			set_present_mode(PRESENT_COPY);
+		} else if (strcmp(arg, "--present=locked") == 0) {
+			set_present_mode(PRESENT_LOCKED);
+		} else if (strcmp(arg, "--depth=float") == 0) {
+			set_depth_format(DEPTH_FLOAT);
+		} else if (strcmp(arg, "--depth=reversed") == 0) {
+			set_depth_format(DEPTH_FLOAT_REVERSED);
+		} else if (strcmp(arg, "--depth=24") == 0) {
+			set_depth_format(DEPTH_UNORM24);
+		} else if (strcmp(arg, "--depth=16") == 0) {
+			set_depth_format(DEPTH_UNORM16);
+		} else if (strcmp(arg, "--dynres=on") == 0) {
+			dynamic_resolution = true;
+		} else if (strcmp(arg, "--dynres=off") == 0) {
+			dynamic_resolution = false;
+		} else if (strncmp(arg, "--dynres-min=", 13) == 0) {
+			min_render_scale = atof(arg + 13);
+			if (min_render_scale < MIN_RENDER_SCALE) min_render_scale = MIN_RENDER_SCALE;
+			if (min_render_scale > 1.0) min_render_scale = 1.0;
+		} else if (strcmp(arg, "--sort=material") == 0) {
+			set_draw_order(DRAW_ORDER_MATERIAL);
+		} else if (strcmp(arg, "--sort=front-to-back") == 0) {
+			set_draw_order(DRAW_ORDER_FRONT_TO_BACK);
+		} else if (strcmp(arg, "--visibility=on") == 0) {
+			set_visibility_buffer(true);
+		} else if (strcmp(arg, "--visibility=off") == 0) {
+			set_visibility_buffer(false);
+		} else if (strncmp(arg, "--scene=", 8) == 0) {
+			scene_path = arg + 8;
+		} else if (strncmp(arg, "--threads=", 10) == 0) {
+			num_threads = atoi(arg + 10);
+		} else if (strcmp(arg, "--pin-threads") == 0) {
+			pin_threads = true;
+		} else if (strcmp(arg, "--lod=auto") == 0) {
+			lod_setting = LOD_AUTO;
+		} else if (strncmp(arg, "--lod=", 6) == 0) {
+			// Past the mesh's coarsest level draws the coarsest
+			lod_setting = atoi(arg + 6) > 0 ? atoi(arg + 6) : 0;
+		} else if (strncmp(arg, "--fps=", 6) == 0) {
+			target_fps = atoi(arg + 6);
+			if (target_fps <= 0) frame_pacing = PACING_UNCAPPED;
+		} else if (strcmp(arg, "--uncapped") == 0) {
+			frame_pacing = PACING_UNCAPPED;
+		} else if (strcmp(arg, "--benchmark") == 0) {
+			// Same frames on every run: fixed steps, fixed resolution, no pacing
+			frame_pacing = PACING_BENCHMARK;
+			dynamic_resolution = false;
+		} else if (strcmp(arg, "--profile") == 0) {
+			show_profile_overlay = true;
+		} else if (strcmp(arg, "--headless") == 0) {
+			// Offscreen through SDL's dummy video driver, stats go to stdout
+			headless = true;
+		} else if (strncmp(arg, "--frames=", 9) == 0) {
+			max_frames = atoi(arg + 9);
+		} else if (strcmp(arg, "--trace") == 0) {
+			trace_on_start = true;
+		} else if (strncmp(arg, "--trace=", 8) == 0) {
+			trace_on_start = true;
+			trace_path = arg + 8;
+		} else if (strcmp(arg, "--bench-suite") == 0 || strncmp(arg, "--bench-suite=", 14) == 0) {
+			enable_benchmark_suite(arg[13] == '=' ? arg + 14 : "benchmark");
+		} else if (strncmp(arg, "--bench-frames=", 15) == 0) {
+			benchmark_frames = atoi(arg + 15);
+		} else if (strcmp(arg, "--golden") == 0 || strncmp(arg, "--golden=", 9) == 0) {
+			// Compare the suite's last frame of every run against DIR/<asset>_<method>.png
+			golden_mode = GOLDEN_COMPARE;
+			if (arg[8] == '=') golden_directory = arg + 9;
+		} else if (strcmp(arg, "--golden-update") == 0 || strncmp(arg, "--golden-update=", 16) == 0) {
+			golden_mode = GOLDEN_UPDATE;
+			if (arg[15] == '=') golden_directory = arg + 16;
+		} else if (strncmp(arg, "--golden-tolerance=", 19) == 0) {
+			golden_tolerance = atoi(arg + 19);
+		} else if (strncmp(arg, "--golden-max-bad=", 17) == 0) {
+			golden_max_bad_pixels = atoi(arg + 17);
+		} else if (strncmp(arg, "--", 2) == 0) {
+			fprintf(stderr, "Unknown option %s\n", arg);
+			return false;
+		} else {
+			*object_path = arg;
+		}
+	}
+	// Golden images are frames of the suite
+	if (golden_mode != GOLDEN_OFF && benchmark_prefix == NULL) {
+		enable_benchmark_suite("benchmark");
+	}
+	init_golden_images(golden_mode, golden_directory, golden_tolerance, golden_max_bad_pixels);
+	return true;
 }
 
 int main(int argc, char* argv[]) {
-	char* object_path;
-	if (argc > 1) {
-		object_path = argv[1];
-	} else {
-		object_path = "./assets/cube.obj";
+	char* object_path = "./assets/cube.obj";
+	if (!parse_arguments(argc, argv, &object_path)) {
+		return 1;
+	}
+	if (headless) {
+		SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
 	}
+	// The suite times frames itself, profiling would only add to them
+	set_profiling(show_profile_overlay || (headless && benchmark_prefix == NULL));
+	init_profiler();
+	init_tracing();
+	set_trace_thread_name("main");
+	set_tracing(trace_on_start);
 	setup(object_path);
+	if (is_running && benchmark_prefix != NULL) {
+		is_running = start_benchmark_suite(asset_paths, NUM_ASSETS, benchmark_frames, benchmark_prefix, vec3_new(0, 0, CAMERA_Z_OFFSET));
+	}
 
+	int frame = 0;
 	while (is_running) {
-		update();
-		render();
+		TRACE_SCOPE("update") {
+			update();
+		}
+		TRACE_SCOPE("render") {
+			render();
+		}
+
+		frame++;
+		if (is_benchmark_running() && !benchmark_end_frame(num_faces_in)) {
+			is_running = false;
+		}
+		if (headless && is_profiling_enabled() && frame % PROFILE_HISTORY == 0) {
+			printf("frame %d\n", frame);
+			print_profile_report(stdout);
+			if (should_render_overdraw()) print_overdraw_stats(stdout);
+		}
+		if (max_frames > 0 && frame >= max_frames) {
+			is_running = false;
+		}
+	}
+	if (headless && is_profiling_enabled() && frame % PROFILE_HISTORY != 0) {
+		printf("frame %d\n", frame);
+		print_profile_report(stdout);
+		if (should_render_overdraw()) print_overdraw_stats(stdout);
 	}
 
 	destroy_window();
 
 	free_resources();
 
-	return 0;
+	// Every thread that records has been joined by now
+	if (is_tracing_enabled() && write_trace_file(trace_path)) {
+		printf("Wrote trace %s\n", trace_path);
+	}
+	free_trace_buffers();
+
+	return get_golden_failures() > 0 ? 1 : 0;
 }
@@ -0,0 +1,119 @@
+#include <stdio.h>
+#include <string.h>
+#include "array.h"
+#include "material.h"
+
+material_t default_material(void) {
+	material_t material = {
+		.name = "",
+		.texture_path = "",
+		.color = 0xFFFFFFFF,
+		.texture = { .png = NULL, .texels = NULL, .width = 0, .height = 0 }
+	};
+	return material;
+}
+
+static uint32_t color_channel(float value) {
+	if (value < 0) {
+		value = 0;
+	} else if (value > 1) {
+		value = 1;
+	}
+	return (uint32_t)(value * 255);
+}
+
+static uint32_t color_from_floats(float r, float g, float b) {
+	return 0xFF000000 | (color_channel(r) << 16) | (color_channel(g) << 8) | color_channel(b);
+}
+
+// Resolve file_name relative to the directory base_path lives in
+void path_next_to(char* out, int size, char* base_path, char* file_name) {
+	char* slash = strrchr(base_path, '/');
+	int dir_length = slash != NULL ? (int)(slash - base_path) + 1 : 0;
+	if (snprintf(out, size, "%.*s%s", dir_length, base_path, file_name) >= size) {
+		fprintf(stderr, "Path to %s is too long, truncated.\n", file_name);
+	}
+}
+
+// Decode the diffuse map of the material at index, reusing texels of an
+// earlier material that points at the same file
+static void load_material_texture(material_t* materials, int index) {
+	material_t* material = &materials[index];
+	for (int i = 0; i < index; i++) {
+		if (strcmp(materials[i].texture_path, material->texture_path) == 0) {
+			material->texture = materials[i].texture;
+			material->texture.png = NULL;  // borrowed, freed with the first material
+			return;
+		}
+	}
+	if (!load_png_texture(&material->texture, material->texture_path)) {
+		fprintf(stderr, "Material %s: could not load diffuse map %s.\n", material->name, material->texture_path);
+	}
+}
+
+// Append the materials of an mtl file to the dynamic array *materials
+bool load_mtl_file_into(material_t** materials, char* filepath) {
+	FILE* file = fopen(filepath, "r");
+	if (file == NULL) {
+		return false;
+	}
+
+	char line[1024];
+	material_t* current = NULL;
+	while (fgets(line, 1024, file)) {
+		if (strncmp(line, "newmtl ", 7) == 0) {
+			if (array_length(*materials) >= MAX_MATERIALS_PER_MESH) {
+				fprintf(stderr, "Too many materials in %s, ignoring the rest.\n", filepath);
+				current = NULL;
+				continue;
+			}
+			material_t material = default_material();
+			sscanf(line, "newmtl %63s", material.name);
+			array_push(*materials, material);
+			current = &(*materials)[array_length(*materials) - 1];
+			continue;
+		}
+		if (current == NULL) {
+			continue;
+		}
+		// Diffuse color
+		if (strncmp(line, "Kd ", 3) == 0) {
+			float r, g, b;
+			if (sscanf(line, "Kd %f %f %f", &r, &g, &b) == 3) {
+				current->color = color_from_floats(r, g, b);
+			}
+		}
+		// Diffuse map, relative to the mtl file
+		if (strncmp(line, "map_Kd ", 7) == 0) {
+			char map_name[MAX_MATERIAL_PATH];
+			if (sscanf(line, "map_Kd %255s", map_name) == 1) {
+				path_next_to(current->texture_path, MAX_MATERIAL_PATH, filepath, map_name);
+			}
+		}
+	}
+	fclose(file);
+
+	for (int i = 0; i < array_length(*materials); i++) {
+		if ((*materials)[i].texture_path[0] != '\0' && (*materials)[i].texture.texels == NULL) {
+			load_material_texture(*materials, i);
+		}
+	}
+	return true;
+}
+
+// Index of the named material, or the default material (0) when unknown
+int find_material(material_t* materials, char* name) {
+	for (int i = 0; i < array_length(materials); i++) {
+		if (strcmp(materials[i].name, name) == 0) {
+			return i;
+		}
+	}
+	return 0;
+}
+
+void free_materials(material_t* materials) {
+	for (int i = 0; i < array_length(materials); i++) {
+		free_texture(&materials[i].texture);
+	}
+	array_free(materials);
+}
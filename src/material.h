@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "texture.h"
+
+#define MAX_MATERIALS_PER_MESH 256
+#define MAX_MATERIAL_NAME 64
+#define MAX_MATERIAL_PATH 256
+
+////////////////////////////////////////////////////////////////////////////////
+// Materials from obj `usemtl` / `.mtl` files
+////////////////////////////////////////////////////////////////////////////////
+// Each mesh owns a dynamic array of materials and every face stores an index
+// into it. Index 0 is always the default material, which samples the mesh
+// texture (the png next to the obj). Materials with a diffuse map carry their
+// own texture; materials that reference a map already loaded share its texels.
+typedef struct {
+	char name[MAX_MATERIAL_NAME];
+	char texture_path[MAX_MATERIAL_PATH];
+	uint32_t color;     // diffuse color (Kd) as 0xAARRGGBB
+	texture_t texture;  // diffuse map (map_Kd), texels are NULL when there is none
+} material_t;
+
+material_t default_material(void);
+bool load_mtl_file_into(material_t** materials, char* filepath);
+int find_material(material_t* materials, char* name);
+void free_materials(material_t* materials);
+void path_next_to(char* out, int size, char* base_path, char* file_name);
@@ -158,9 +158,9 @@ mat4_t mat4_look_at(vec3_t eye, vec3_t target, vec3_t up) {
 	// | z.x  z.y  z.z  -dot(z,eye) |
 	// | 0    0    0              1 |
 	mat4_t view_matrix = {{
-		{ x.x, x.y, x.z -vec3_dot(x, eye) },
-		{ y.x, y.y, y.z -vec3_dot(y, eye) },
-		{ z.x, z.y, z.z -vec3_dot(z, eye) },
+		{ x.x, x.y, x.z, -vec3_dot(x, eye) },
+		{ y.x, y.y, y.z, -vec3_dot(y, eye) },
+		{ z.x, z.y, z.z, -vec3_dot(z, eye) },
 		{   0,   0,   0,                1 }
 	}};
 	return view_matrix;
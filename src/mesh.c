@@ -1,14 +1,24 @@
+#include <SDL2/SDL.h>
+#include <math.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "array.h"
 #include "mesh.h"
 
 mesh_t mesh = {
     .vertices = NULL,
+    .normals = NULL,
     .faces = NULL,
-    .rotation = { 0, 0, 0 },
-    .scale = { 1.0, 1.0, 1.0 },
-    .translation = { 0, 0, 0 }
+    .materials = NULL,
+    .edges = NULL,
+    .face_edges = NULL,
+    .meshlets = NULL,
+    .meshlet_faces = NULL,
+    .lods = NULL,
+    .center = { 0, 0, 0 },
+    .radius = 0
 };
 
 vec3_t cube_vertices[N_CUBE_VERTICES] = {
@@ -52,21 +62,60 @@ void load_cube_mesh_data(void) {
         face_t cube_face = cube_faces[i];
         array_push(mesh.faces, cube_face);
     }
+    compute_vertex_normals(&mesh);
+    compute_mesh_edges(&mesh);
+    compute_mesh_meshlets(&mesh);
+    compute_mesh_lods(&mesh, NULL);
+}
+
+// Load the mtl named by an mtllib line. Exporters often keep a stale library
+// name, so fall back to the mtl with the same name as the obj.
+static void load_obj_materials(mesh_t* target, char* obj_filename, char* line) {
+    char mtl_name[MAX_MATERIAL_PATH];
+    char mtl_path[MAX_MATERIAL_PATH];
+    if (sscanf(line, "mtllib %255s", mtl_name) == 1) {
+        path_next_to(mtl_path, MAX_MATERIAL_PATH, obj_filename, mtl_name);
+        if (load_mtl_file_into(&target->materials, mtl_path)) {
+            return;
+        }
+    }
+    snprintf(mtl_path, MAX_MATERIAL_PATH, "%s", obj_filename);
+    char* extension = strrchr(mtl_path, '.');
+    if (extension != NULL && (size_t)(extension - mtl_path) + 5 <= MAX_MATERIAL_PATH) {
+        strcpy(extension, ".mtl");
+        load_mtl_file_into(&target->materials, mtl_path);
+    }
 }
 
 void load_obj_file_data(char* filename) {
+    load_obj_file_into(&mesh, filename);
+}
+
+// Parse an obj file into target's vertex and face arrays; touches no globals so
+// it can run on a loader thread
+bool load_obj_file_into(mesh_t* target, char* filename) {
     FILE* file;
     file = fopen(filename, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Error opening obj file %s.\n", filename);
+        return false;
+    }
     char line[1024];
 
     tex2_t* texcoords = NULL;
 
+    // Faces before any usemtl (or naming an unknown material) use the default
+    if (array_length(target->materials) == 0) {
+        array_push(target->materials, default_material());
+    }
+    int current_material = 0;
+
     while (fgets(line, 1024, file)) {
         // Vertex information
         if (strncmp(line, "v ", 2) == 0) {
             vec3_t vertex;
             sscanf(line, "v %f %f %f", &vertex.x, &vertex.y, &vertex.z);
-            array_push(mesh.vertices, vertex);
+            array_push(target->vertices, vertex);
         }
         // Texture coordinate information
         if (strncmp(line, "vt ", 3) == 0) {
@@ -74,6 +123,17 @@ void load_obj_file_data(char* filename) {
             sscanf(line, "vt %f %f", &texcoord.u, &texcoord.v);
             array_push(texcoords, texcoord);
         }
+        // Material library
+        if (strncmp(line, "mtllib ", 7) == 0) {
+            load_obj_materials(target, filename, line);
+        }
+        // Material for the faces that follow
+        if (strncmp(line, "usemtl ", 7) == 0) {
+            char material_name[MAX_MATERIAL_NAME];
+            if (sscanf(line, "usemtl %63s", material_name) == 1) {
+                current_material = find_material(target->materials, material_name);
+            }
+        }
         // Face information
         if (strncmp(line, "f ", 2) == 0) {
             int vertex_indices[3];
@@ -92,9 +152,796 @@ void load_obj_file_data(char* filename) {
                 .a_uv = texcoords[texture_indices[0] - 1],
                 .b_uv = texcoords[texture_indices[1] - 1],
                 .c_uv = texcoords[texture_indices[2] - 1],
-                .color = 0xFFFFFFFF
+                .color = target->materials[current_material].color,
+                .material = current_material
             };
-            array_push(mesh.faces, face);
+            array_push(target->faces, face);
+        }
+    }
+    fclose(file);
+    array_free(texcoords);
+    compute_vertex_normals(target);
+    compute_mesh_edges(target);
+    compute_mesh_meshlets(target);
+
+    // Levels of detail are cached next to the obj, in a .lod file
+    char lod_path[MAX_MATERIAL_PATH];
+    snprintf(lod_path, MAX_MATERIAL_PATH, "%s", filename);
+    char* extension = strrchr(lod_path, '.');
+    if (extension != NULL && (size_t)(extension - lod_path) + 5 <= MAX_MATERIAL_PATH) {
+        strcpy(extension, ".lod");
+        compute_mesh_lods(target, lod_path);
+    } else {
+        compute_mesh_lods(target, NULL);
+    }
+    return true;
+}
+
+static void free_mesh_lods(mesh_t* target);
+
+void free_mesh_data(mesh_t* target) {
+    array_free(target->faces);
+    array_free(target->vertices);
+    array_free(target->normals);
+    free_materials(target->materials);
+    array_free(target->edges);
+    array_free(target->face_edges);
+    array_free(target->meshlets);
+    array_free(target->meshlet_faces);
+    free_mesh_lods(target);
+    target->faces = NULL;
+    target->vertices = NULL;
+    target->normals = NULL;
+    target->materials = NULL;
+    target->edges = NULL;
+    target->face_edges = NULL;
+    target->meshlets = NULL;
+    target->meshlet_faces = NULL;
+}
+
+// Material of a face, NULL for meshes without a material table (builtin cube)
+material_t* get_mesh_material(mesh_t* target, int index) {
+    if (index < 0 || index >= array_length(target->materials)) {
+        return NULL;
+    }
+    return &target->materials[index];
+}
+
+// Smooth normals for Gouraud shading: every vertex gets the sum of the normals
+// of the faces around it (weighted by face area), normalized
+void compute_vertex_normals(mesh_t* target) {
+    array_free(target->normals);
+    target->normals = NULL;
+
+    int num_vertices = array_length(target->vertices);
+    for (int i = 0; i < num_vertices; i++) {
+        array_push(target->normals, vec3_new(0, 0, 0));
+    }
+
+    int num_faces = array_length(target->faces);
+    for (int i = 0; i < num_faces; i++) {
+        int indices[3] = { target->faces[i].a - 1, target->faces[i].b - 1, target->faces[i].c - 1 };
+        if (indices[0] < 0 || indices[0] >= num_vertices ||
+            indices[1] < 0 || indices[1] >= num_vertices ||
+            indices[2] < 0 || indices[2] >= num_vertices) {
+            continue;
+        }
+        vec3_t vector_ab = vec3_sub(target->vertices[indices[1]], target->vertices[indices[0]]);
+        vec3_t vector_ac = vec3_sub(target->vertices[indices[2]], target->vertices[indices[0]]);
+        vec3_t normal = vec3_cross(vector_ab, vector_ac);
+        for (int j = 0; j < 3; j++) {
+            target->normals[indices[j]] = vec3_add(target->normals[indices[j]], normal);
+        }
+    }
+
+    for (int i = 0; i < num_vertices; i++) {
+        if (vec3_length(target->normals[i]) > 0) {
+            vec3_normalize(&target->normals[i]);
+        }
+    }
+}
+
+// Half-edge of a face, sorted by its vertex pair to find the shared edges
+typedef struct {
+    int a;
+    int b;
+    int face_edge;  // index into face_edges
+} face_edge_key_t;
+
+static int compare_face_edge_keys(const void* left, const void* right) {
+    const face_edge_key_t* l = left;
+    const face_edge_key_t* r = right;
+    if (l->a != r->a) return l->a < r->a ? -1 : 1;
+    if (l->b != r->b) return l->b < r->b ? -1 : 1;
+    return l->face_edge - r->face_edge;
+}
+
+// Unique edge list of a level's faces for wireframes, so an edge shared by two
+// faces is drawn once. Faces with out of range vertices get edge -1.
+void compute_lod_edges(mesh_t* target, mesh_lod_t* lod) {
+    array_free(lod->edges);
+    array_free(lod->face_edges);
+    lod->edges = NULL;
+    lod->face_edges = NULL;
+
+    int num_vertices = array_length(target->vertices);
+    int num_faces = array_length(lod->faces);
+    if (num_faces == 0) {
+        return;
+    }
+    lod->face_edges = array_hold(NULL, num_faces * 3, sizeof(int));
+
+    face_edge_key_t* keys = malloc(sizeof(face_edge_key_t) * num_faces * 3);
+    int num_keys = 0;
+    for (int i = 0; i < num_faces; i++) {
+        int indices[3] = { lod->faces[i].a - 1, lod->faces[i].b - 1, lod->faces[i].c - 1 };
+        for (int j = 0; j < 3; j++) {
+            int a = indices[j];
+            int b = indices[(j + 1) % 3];
+            lod->face_edges[i * 3 + j] = -1;
+            if (a < 0 || a >= num_vertices || b < 0 || b >= num_vertices) {
+                continue;
+            }
+            keys[num_keys].a = a < b ? a : b;
+            keys[num_keys].b = a < b ? b : a;
+            keys[num_keys].face_edge = i * 3 + j;
+            num_keys++;
+        }
+    }
+    qsort(keys, num_keys, sizeof(face_edge_key_t), compare_face_edge_keys);
+
+    for (int i = 0; i < num_keys; i++) {
+        if (i == 0 || keys[i].a != keys[i - 1].a || keys[i].b != keys[i - 1].b) {
+            edge_t edge = { .a = keys[i].a, .b = keys[i].b };
+            array_push(lod->edges, edge);
         }
+        lod->face_edges[keys[i].face_edge] = array_length(lod->edges) - 1;
+    }
+    free(keys);
+}
+
+// Edges of the full mesh
+void compute_mesh_edges(mesh_t* target) {
+    mesh_lod_t lod = get_mesh_lod(target, 0);
+    compute_lod_edges(target, &lod);
+    target->edges = lod.edges;
+    target->face_edges = lod.face_edges;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Levels of detail
+////////////////////////////////////////////////////////////////////////////////
+// Level 0 is the full mesh, whose arrays live in the mesh itself
+int get_mesh_lod_count(mesh_t* target) {
+    return 1 + array_length(target->lods);
+}
+
+mesh_lod_t get_mesh_lod(mesh_t* target, int level) {
+    if (level > 0 && level <= array_length(target->lods)) {
+        return target->lods[level - 1];
+    }
+    mesh_lod_t lod = {
+        .faces = target->faces,
+        .edges = target->edges,
+        .face_edges = target->face_edges,
+        .meshlets = target->meshlets,
+        .meshlet_faces = target->meshlet_faces,
+        .error = 0
+    };
+    return lod;
+}
+
+static void free_mesh_lods(mesh_t* target) {
+    for (int i = 0; i < array_length(target->lods); i++) {
+        mesh_lod_t* lod = &target->lods[i];
+        array_free(lod->faces);
+        array_free(lod->edges);
+        array_free(lod->face_edges);
+        array_free(lod->meshlets);
+        array_free(lod->meshlet_faces);
+    }
+    array_free(target->lods);
+    target->lods = NULL;
+}
+
+// Symmetric 4x4 error quadric, upper triangle row by row:
+// xx xy xz xw yy yz yw zz zw ww, over the summed area of its planes
+typedef struct {
+    double q[10];
+    double area;
+} quadric_t;
+
+static void quadric_add_plane(quadric_t* quadric, vec3_t normal, double distance, double area) {
+    double plane[4] = { normal.x, normal.y, normal.z, distance };
+    int k = 0;
+    for (int i = 0; i < 4; i++) {
+        for (int j = i; j < 4; j++) {
+            quadric->q[k++] += plane[i] * plane[j] * area;
+        }
+    }
+    quadric->area += area;
+}
+
+static void quadric_add(quadric_t* quadric, const quadric_t* other) {
+    for (int k = 0; k < 10; k++) {
+        quadric->q[k] += other->q[k];
+    }
+    quadric->area += other->area;
+}
+
+// Area weighted mean squared distance from a point to the planes of two quadrics
+static double quadric_error(const quadric_t* a, const quadric_t* b, vec3_t point) {
+    double p[4] = { point.x, point.y, point.z, 1 };
+    double error = 0;
+    int k = 0;
+    for (int i = 0; i < 4; i++) {
+        for (int j = i; j < 4; j++, k++) {
+            double term = (a->q[k] + b->q[k]) * p[i] * p[j];
+            error += i == j ? term : 2 * term;
+        }
+    }
+    double area = a->area + b->area;
+    return error > 0 && area > 0 ? error / area : 0;
+}
+
+// Collapse of vertex from onto vertex to, valid while both stamps match
+typedef struct {
+    double cost;
+    int from;
+    int to;
+    int from_stamp;
+    int to_stamp;
+} collapse_t;
+
+// Obj exporters split a vertex wherever its uv or normal changes, so seams are
+// open borders between two copies at one position, called twins here. A twin
+// only moves together with its twin, along the seam, onto the twins of a seam
+// neighbour, so both sides of the seam stay joined.
+typedef struct {
+    const vec3_t* vertices;
+    int num_vertices;
+    int num_faces;
+    int* corners;           // vertices of face i at 3i..3i+2, 0-based
+    tex2_t* uvs;            // parallel to corners
+    bool* face_alive;
+    int live_faces;
+    int** vertex_faces;     // dynamic arrays of faces per vertex, dead ones left in
+    int* twins;             // other vertex at the same position, -1 if none
+    quadric_t* quadrics;    // shared by twins
+    bool* locked;
+    bool* removed;
+    int* stamps;
+    int* marks;             // scratch for the link test, compared to mark
+    int mark;
+    collapse_t* heap;       // binary min heap on cost
+    int heap_size;
+    int heap_capacity;
+    double max_cost;        // of the collapses done so far
+} simplifier_t;
+
+static void heap_push(simplifier_t* s, collapse_t collapse) {
+    if (s->heap_size == s->heap_capacity) {
+        s->heap_capacity = s->heap_capacity > 0 ? s->heap_capacity * 2 : 256;
+        s->heap = realloc(s->heap, sizeof(collapse_t) * s->heap_capacity);
+    }
+    int i = s->heap_size++;
+    while (i > 0 && s->heap[(i - 1) / 2].cost > collapse.cost) {
+        s->heap[i] = s->heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    s->heap[i] = collapse;
+}
+
+static collapse_t heap_pop(simplifier_t* s) {
+    collapse_t top = s->heap[0];
+    collapse_t last = s->heap[--s->heap_size];
+    int i = 0;
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= s->heap_size) break;
+        if (child + 1 < s->heap_size && s->heap[child + 1].cost < s->heap[child].cost) child++;
+        if (s->heap[child].cost >= last.cost) break;
+        s->heap[i] = s->heap[child];
+        i = child;
+    }
+    if (s->heap_size > 0) {
+        s->heap[i] = last;
+    }
+    return top;
+}
+
+static void push_collapse(simplifier_t* s, int from, int to) {
+    if (s->locked[from]) {
+        return;
+    }
+    collapse_t collapse = {
+        .cost = quadric_error(&s->quadrics[from], &s->quadrics[to], s->vertices[to]),
+        .from = from,
+        .to = to,
+        .from_stamp = s->stamps[from],
+        .to_stamp = s->stamps[to]
+    };
+    heap_push(s, collapse);
+}
+
+static int face_corner(simplifier_t* s, int face, int vertex) {
+    for (int j = 0; j < 3; j++) {
+        if (s->corners[face * 3 + j] == vertex) return j;
+    }
+    return -1;
+}
+
+static bool same_uv(tex2_t a, tex2_t b) {
+    return a.u == b.u && a.v == b.v;
+}
+
+static vec3_t corner_normal(simplifier_t* s, int a, int b, int c) {
+    vec3_t ab = vec3_sub(s->vertices[b], s->vertices[a]);
+    vec3_t ac = vec3_sub(s->vertices[c], s->vertices[a]);
+    return vec3_cross(ab, ac);
+}
+
+static bool same_position(vec3_t a, vec3_t b) {
+    return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+// A vertex with its position, so qsort needs no context and meshes can be
+// simplified on several threads at once
+typedef struct {
+    vec3_t position;
+    int index;
+} sorted_vertex_t;
+
+static int compare_vertex_positions(const void* left, const void* right) {
+    const sorted_vertex_t* l = left;
+    const sorted_vertex_t* r = right;
+    if (l->position.x != r->position.x) return l->position.x < r->position.x ? -1 : 1;
+    if (l->position.y != r->position.y) return l->position.y < r->position.y ? -1 : 1;
+    if (l->position.z != r->position.z) return l->position.z < r->position.z ? -1 : 1;
+    return l->index - r->index;
+}
+
+// Pair up vertices that share a position. Three or more at one position get
+// no twins, and stay locked for their open fans.
+static void find_twins(simplifier_t* s) {
+    sorted_vertex_t* order = malloc(sizeof(sorted_vertex_t) * s->num_vertices);
+    for (int v = 0; v < s->num_vertices; v++) {
+        order[v] = (sorted_vertex_t){ s->vertices[v], v };
+        s->twins[v] = -1;
+    }
+    qsort(order, s->num_vertices, sizeof(sorted_vertex_t), compare_vertex_positions);
+    for (int i = 0; i < s->num_vertices;) {
+        int end = i + 1;
+        while (end < s->num_vertices && same_position(order[end].position, order[i].position)) {
+            end++;
+        }
+        if (end - i == 2) {
+            s->twins[order[i].index] = order[i + 1].index;
+            s->twins[order[i + 1].index] = order[i].index;
+        }
+        i = end;
+    }
+    free(order);
+}
+
+// Count (amount 1), test, or clear (amount 0) the welded neighbours of a
+// vertex and its twin, where a pair of twins counts as its lower vertex
+static bool count_welded_neighbours(simplifier_t* s, int v, int* counts, int amount) {
+    int members[2] = { v, s->twins[v] };
+    bool closed = true;
+    for (int m = 0; m < (members[1] >= 0 ? 2 : 1); m++) {
+        int* fan = s->vertex_faces[members[m]];
+        for (int i = 0; i < array_length(fan); i++) {
+            for (int j = 0; j < 3; j++) {
+                int w = s->corners[fan[i] * 3 + j];
+                if (w == members[m]) continue;
+                int welded = s->twins[w] >= 0 && s->twins[w] < w ? s->twins[w] : w;
+                if (amount < 0) closed &= counts[welded] == 2;
+                else counts[welded] = amount ? counts[welded] + 1 : 0;
+            }
+        }
+    }
+    return closed;
+}
+
+// A vertex may only move when its faces, with its twin's, close a fan around
+// it and share one material, and its own faces agree on its uv. Open borders,
+// non manifold spots and material borders stay put.
+static void lock_vertices(simplifier_t* s, const face_t* faces) {
+    int* neighbour_count = calloc(s->num_vertices, sizeof(int));
+    for (int v = 0; v < s->num_vertices; v++) {
+        int* fan = s->vertex_faces[v];
+        int* twin_fan = s->twins[v] >= 0 ? s->vertex_faces[s->twins[v]] : NULL;
+        bool locked = array_length(fan) == 0;
+        for (int i = 0; i < array_length(fan) && !locked; i++) {
+            int f = fan[i];
+            locked |= faces[f].material != faces[fan[0]].material;
+            locked |= !same_uv(s->uvs[f * 3 + face_corner(s, f, v)], s->uvs[fan[0] * 3 + face_corner(s, fan[0], v)]);
+        }
+        for (int i = 0; i < array_length(twin_fan) && !locked; i++) {
+            locked |= faces[twin_fan[i]].material != faces[fan[0]].material;
+        }
+        if (!locked) {
+            // Closed fan: every welded neighbour is shared by exactly two faces
+            count_welded_neighbours(s, v, neighbour_count, 1);
+            locked = !count_welded_neighbours(s, v, neighbour_count, -1);
+            count_welded_neighbours(s, v, neighbour_count, 0);
+        }
+        s->locked[v] = locked;
+    }
+    free(neighbour_count);
+}
+
+// Whether from can move onto to on one side of the edge between them, which
+// must lie on edge_faces faces: 2 inside a fan, 1 along a seam. Gives the uv
+// at to that the faces keeping from take.
+static bool can_collapse(simplifier_t* s, int from, int to, int edge_faces, tex2_t* to_uv) {
+    int shared = 0;
+    int* fan = s->vertex_faces[from];
+    for (int i = 0; i < array_length(fan); i++) {
+        int f = fan[i];
+        int corner = s->face_alive[f] ? face_corner(s, f, to) : -1;
+        if (corner < 0) continue;
+        if (shared > 0 && !same_uv(*to_uv, s->uvs[f * 3 + corner])) return false;
+        *to_uv = s->uvs[f * 3 + corner];
+        shared++;
+    }
+    if (shared != edge_faces) {
+        return false;
+    }
+
+    // Link condition: the ends only share the vertices opposite the edge
+    int to_mark = ++s->mark;
+    int* to_fan = s->vertex_faces[to];
+    for (int i = 0; i < array_length(to_fan); i++) {
+        if (!s->face_alive[to_fan[i]]) continue;
+        for (int j = 0; j < 3; j++) s->marks[s->corners[to_fan[i] * 3 + j]] = to_mark;
+    }
+    int common_mark = ++s->mark;
+    int common = 0;
+    for (int i = 0; i < array_length(fan); i++) {
+        if (!s->face_alive[fan[i]]) continue;
+        for (int j = 0; j < 3; j++) {
+            int w = s->corners[fan[i] * 3 + j];
+            if (w != from && w != to && s->marks[w] == to_mark) {
+                s->marks[w] = common_mark;
+                common++;
+            }
+        }
+    }
+    if (common != edge_faces) {
+        return false;
+    }
+
+    // No face that stays may flip over or collapse to a line
+    for (int i = 0; i < array_length(fan); i++) {
+        int f = fan[i];
+        if (!s->face_alive[f] || face_corner(s, f, to) >= 0) continue;
+        int* corners = &s->corners[f * 3];
+        int moved[3];
+        for (int j = 0; j < 3; j++) moved[j] = corners[j] == from ? to : corners[j];
+        vec3_t before = corner_normal(s, corners[0], corners[1], corners[2]);
+        vec3_t after = corner_normal(s, moved[0], moved[1], moved[2]);
+        if (vec3_dot(before, after) <= 0 || vec3_length(after) == 0) return false;
+    }
+    return true;
+}
+
+// Drop the faces on the edge and move the rest of from's faces onto to
+static void collapse_edge(simplifier_t* s, int from, int to, tex2_t to_uv) {
+    int* fan = s->vertex_faces[from];
+    for (int i = 0; i < array_length(fan); i++) {
+        int f = fan[i];
+        if (!s->face_alive[f]) continue;
+        if (face_corner(s, f, to) >= 0) {
+            s->face_alive[f] = false;
+            s->live_faces--;
+            continue;
+        }
+        int corner = face_corner(s, f, from);
+        s->corners[f * 3 + corner] = to;
+        s->uvs[f * 3 + corner] = to_uv;
+        array_push(s->vertex_faces[to], f);
+    }
+    s->removed[from] = true;
+    s->stamps[to]++;
+}
+
+static void push_fan_collapses(simplifier_t* s, int vertex) {
+    int* fan = s->vertex_faces[vertex];
+    for (int i = 0; i < array_length(fan); i++) {
+        if (!s->face_alive[fan[i]]) continue;
+        for (int j = 0; j < 3; j++) {
+            int w = s->corners[fan[i] * 3 + j];
+            if (w == vertex) continue;
+            push_collapse(s, w, vertex);
+            push_collapse(s, vertex, w);
+        }
+    }
+}
+
+// Collapse an edge inside a fan, or a seam edge on both of its sides, if
+// the edge is still there and the surface stays manifold without flips
+static bool try_collapse(simplifier_t* s, collapse_t collapse) {
+    int from = collapse.from;
+    int to = collapse.to;
+    if (s->removed[from] || s->removed[to] ||
+        s->stamps[from] != collapse.from_stamp || s->stamps[to] != collapse.to_stamp) {
+        return false;
+    }
+
+    int twin_from = s->twins[from];
+    int twin_to = s->twins[to];
+    tex2_t to_uv = { 0, 0 };
+    tex2_t twin_uv = { 0, 0 };
+    if (twin_from < 0) {
+        if (!can_collapse(s, from, to, 2, &to_uv)) return false;
+    } else {
+        if (twin_to < 0 || s->removed[twin_to] ||
+            !can_collapse(s, from, to, 1, &to_uv) || !can_collapse(s, twin_from, twin_to, 1, &twin_uv)) {
+            return false;
+        }
+    }
+
+    collapse_edge(s, from, to, to_uv);
+    quadric_add(&s->quadrics[to], &s->quadrics[from]);
+    if (twin_from >= 0) {
+        collapse_edge(s, twin_from, twin_to, twin_uv);
+    }
+    if (twin_to >= 0) {
+        s->quadrics[twin_to] = s->quadrics[to];
+        s->stamps[twin_to]++;
+    }
+    if (collapse.cost > s->max_cost) s->max_cost = collapse.cost;
+
+    push_fan_collapses(s, to);
+    if (twin_to >= 0) {
+        push_fan_collapses(s, twin_to);
+    }
+    return true;
+}
+
+// Faces alive in the simplifier, in the order of the full mesh
+static mesh_lod_t snapshot_lod(simplifier_t* s, const face_t* faces) {
+    mesh_lod_t lod = { 0 };
+    for (int f = 0; f < s->num_faces; f++) {
+        if (!s->face_alive[f]) continue;
+        face_t face = faces[f];
+        face.a = s->corners[f * 3 + 0] + 1;
+        face.b = s->corners[f * 3 + 1] + 1;
+        face.c = s->corners[f * 3 + 2] + 1;
+        face.a_uv = s->uvs[f * 3 + 0];
+        face.b_uv = s->uvs[f * 3 + 1];
+        face.c_uv = s->uvs[f * 3 + 2];
+        array_push(lod.faces, face);
+    }
+    lod.error = sqrt(s->max_cost);
+    return lod;
+}
+
+// Bump whenever a change to the simplifier changes the levels it makes, so
+// caches written by an older one are simplified again
+#define LOD_SIMPLIFIER_VERSION 2
+
+#define LOD_REDUCTION 2				// faces of a level over the next one's target
+#define LOD_MIN_SHRINK_PERCENT 10	// a level short of its target is kept if this much smaller
+
+// Collapse the cheapest edges first, keeping a level each time the faces
+// halve. Stops early when the movable vertices run out, keeping what it got
+// if it is still a tenth smaller than the previous level.
+static void simplify_mesh(mesh_t* target) {
+    simplifier_t s = { 0 };
+    s.vertices = target->vertices;
+    s.num_vertices = array_length(target->vertices);
+    s.num_faces = array_length(target->faces);
+    s.corners = malloc(sizeof(int) * s.num_faces * 3);
+    s.uvs = malloc(sizeof(tex2_t) * s.num_faces * 3);
+    s.face_alive = calloc(s.num_faces, sizeof(bool));
+    s.vertex_faces = calloc(s.num_vertices, sizeof(int*));
+    s.twins = malloc(sizeof(int) * s.num_vertices);
+    s.quadrics = calloc(s.num_vertices, sizeof(quadric_t));
+    s.locked = calloc(s.num_vertices, sizeof(bool));
+    s.removed = calloc(s.num_vertices, sizeof(bool));
+    s.stamps = calloc(s.num_vertices, sizeof(int));
+    s.marks = calloc(s.num_vertices, sizeof(int));
+
+    // Faces with out of range or repeated vertices are left out of every level
+    for (int f = 0; f < s.num_faces; f++) {
+        face_t face = target->faces[f];
+        int corners[3] = { face.a - 1, face.b - 1, face.c - 1 };
+        tex2_t uvs[3] = { face.a_uv, face.b_uv, face.c_uv };
+        bool valid = corners[0] != corners[1] && corners[1] != corners[2] && corners[0] != corners[2];
+        for (int j = 0; j < 3; j++) {
+            valid &= corners[j] >= 0 && corners[j] < s.num_vertices;
+            s.corners[f * 3 + j] = corners[j];
+            s.uvs[f * 3 + j] = uvs[j];
+        }
+        if (!valid) continue;
+        s.face_alive[f] = true;
+        s.live_faces++;
+
+        vec3_t normal = corner_normal(&s, corners[0], corners[1], corners[2]);
+        float length = vec3_length(normal);
+        for (int j = 0; j < 3; j++) {
+            array_push(s.vertex_faces[corners[j]], f);
+            if (length > 0) {
+                vec3_t unit = vec3_mul(normal, 1.0 / length);
+                quadric_add_plane(&s.quadrics[corners[j]], unit, -vec3_dot(unit, s.vertices[corners[0]]), length / 2);
+            }
+        }
+    }
+    find_twins(&s);
+    for (int v = 0; v < s.num_vertices; v++) {
+        int twin = s.twins[v];
+        if (twin > v) {
+            quadric_add(&s.quadrics[v], &s.quadrics[twin]);
+            s.quadrics[twin] = s.quadrics[v];
+        }
+    }
+    lock_vertices(&s, target->faces);
+
+    for (int f = 0; f < s.num_faces; f++) {
+        if (!s.face_alive[f]) continue;
+        for (int j = 0; j < 3; j++) {
+            int a = s.corners[f * 3 + j];
+            int b = s.corners[f * 3 + (j + 1) % 3];
+            push_collapse(&s, a, b);
+            push_collapse(&s, b, a);
+        }
+    }
+
+    int previous_faces = s.live_faces;
+    int target_faces = s.live_faces / LOD_REDUCTION;
+    while (s.live_faces > 0 && array_length(target->lods) < MESH_MAX_LODS) {
+        while (s.heap_size > 0 && s.live_faces > target_faces) {
+            try_collapse(&s, heap_pop(&s));
+        }
+        if (s.live_faces > target_faces && s.live_faces > previous_faces * (100 - LOD_MIN_SHRINK_PERCENT) / 100) {
+            break;
+        }
+        mesh_lod_t lod = snapshot_lod(&s, target->faces);
+        array_push(target->lods, lod);
+        if (s.live_faces > target_faces) {
+            break;
+        }
+        previous_faces = s.live_faces;
+        target_faces = s.live_faces / LOD_REDUCTION;
+    }
+
+    for (int v = 0; v < s.num_vertices; v++) {
+        array_free(s.vertex_faces[v]);
+    }
+    free(s.heap);
+    free(s.marks);
+    free(s.stamps);
+    free(s.removed);
+    free(s.locked);
+    free(s.quadrics);
+    free(s.twins);
+    free(s.vertex_faces);
+    free(s.face_alive);
+    free(s.uvs);
+    free(s.corners);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Level cache: "LOD1", a hash of the full mesh and the simplifier's version and
+// targets, the level count, then per level its error, face count and faces.
+// Written in the host's byte order.
+////////////////////////////////////////////////////////////////////////////////
+#define LOD_CACHE_MAGIC 0x31444F4C
+
+// FNV-1a
+static uint32_t hash_bytes(uint32_t hash, const void* data, size_t size) {
+    const unsigned char* bytes = data;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static uint32_t hash_mesh(mesh_t* target) {
+    int settings[4] = { LOD_SIMPLIFIER_VERSION, MESH_MAX_LODS, LOD_REDUCTION, LOD_MIN_SHRINK_PERCENT };
+    uint32_t hash = hash_bytes(2166136261u, settings, sizeof(settings));
+    hash = hash_bytes(hash, target->vertices, sizeof(vec3_t) * array_length(target->vertices));
+    return hash_bytes(hash, target->faces, sizeof(face_t) * array_length(target->faces));
+}
+
+// Levels from the cache if it was written for this mesh, every face in range
+static bool read_lod_cache(mesh_t* target, const char* path, uint32_t hash) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return false;
+    }
+    uint32_t header[2];
+    int32_t num_levels = 0;
+    bool valid = fread(header, sizeof(header), 1, file) == 1 && fread(&num_levels, sizeof(num_levels), 1, file) == 1 &&
+        header[0] == LOD_CACHE_MAGIC && header[1] == hash && num_levels >= 0 && num_levels <= MESH_MAX_LODS;
+    int num_vertices = array_length(target->vertices);
+    for (int i = 0; valid && i < num_levels; i++) {
+        mesh_lod_t lod = { 0 };
+        int32_t num_faces = 0;
+        valid = fread(&lod.error, sizeof(lod.error), 1, file) == 1 && fread(&num_faces, sizeof(num_faces), 1, file) == 1 &&
+            num_faces > 0 && num_faces <= array_length(target->faces);
+        if (valid) {
+            lod.faces = array_hold(NULL, num_faces, sizeof(face_t));
+            valid = fread(lod.faces, sizeof(face_t), num_faces, file) == (size_t)num_faces;
+        }
+        for (int f = 0; valid && f < num_faces; f++) {
+            face_t face = lod.faces[f];
+            valid = face.a >= 1 && face.a <= num_vertices && face.b >= 1 && face.b <= num_vertices &&
+                face.c >= 1 && face.c <= num_vertices;
+        }
+        array_push(target->lods, lod);
+    }
+    fclose(file);
+    if (!valid) {
+        free_mesh_lods(target);
+    }
+    return valid;
+}
+
+// Written to a file of this thread's own and renamed over the cache once
+// complete, since loads on other threads (or processes) may write the same
+// cache, or read it, meanwhile
+static void write_lod_cache(mesh_t* target, const char* path, uint32_t hash) {
+    char temporary_path[MAX_MATERIAL_PATH + 40];
+    snprintf(temporary_path, sizeof(temporary_path), "%s.%lx.%llx.tmp",
+        path, (unsigned long)SDL_ThreadID(), (unsigned long long)SDL_GetPerformanceCounter());
+    FILE* file = fopen(temporary_path, "wb");
+    if (file == NULL) {
+        return;
+    }
+    uint32_t header[2] = { LOD_CACHE_MAGIC, hash };
+    int32_t num_levels = array_length(target->lods);
+    bool written = fwrite(header, sizeof(header), 1, file) == 1 && fwrite(&num_levels, sizeof(num_levels), 1, file) == 1;
+    for (int i = 0; written && i < num_levels; i++) {
+        mesh_lod_t* lod = &target->lods[i];
+        int32_t num_faces = array_length(lod->faces);
+        written = fwrite(&lod->error, sizeof(lod->error), 1, file) == 1 && fwrite(&num_faces, sizeof(num_faces), 1, file) == 1 &&
+            fwrite(lod->faces, sizeof(face_t), num_faces, file) == (size_t)num_faces;
+    }
+    bool complete = fclose(file) == 0 && written;
+    // Where rename does not replace an existing file (Windows), remove it first
+    if (complete && rename(temporary_path, path) != 0) {
+        remove(path);
+        complete = rename(temporary_path, path) == 0;
+    }
+    if (!complete) {
+        remove(temporary_path);
+    }
+}
+
+// Bounding sphere for picking a level, and the coarser levels, read from the
+// cache at cache_path when it matches the mesh (NULL for no cache), otherwise
+// simplified and written there
+void compute_mesh_lods(mesh_t* target, const char* cache_path) {
+    free_mesh_lods(target);
+
+    int num_vertices = array_length(target->vertices);
+    vec3_t min = vec3_new(INFINITY, INFINITY, INFINITY);
+    vec3_t max = vec3_new(-INFINITY, -INFINITY, -INFINITY);
+    for (int i = 0; i < num_vertices; i++) {
+        vec3_t vertex = target->vertices[i];
+        min = vec3_new(fminf(min.x, vertex.x), fminf(min.y, vertex.y), fminf(min.z, vertex.z));
+        max = vec3_new(fmaxf(max.x, vertex.x), fmaxf(max.y, vertex.y), fmaxf(max.z, vertex.z));
+    }
+    target->center = num_vertices > 0 ? vec3_mul(vec3_add(min, max), 0.5) : vec3_new(0, 0, 0);
+    target->radius = 0;
+    for (int i = 0; i < num_vertices; i++) {
+        float distance = vec3_length(vec3_sub(target->vertices[i], target->center));
+        if (distance > target->radius) target->radius = distance;
+    }
+
+    uint32_t hash = hash_mesh(target);
+    if (cache_path == NULL || !read_lod_cache(target, cache_path, hash)) {
+        simplify_mesh(target);
+        if (cache_path != NULL) {
+            write_lod_cache(target, cache_path, hash);
+        }
+    }
+    for (int i = 0; i < array_length(target->lods); i++) {
+        compute_lod_edges(target, &target->lods[i]);
+        compute_lod_meshlets(target, &target->lods[i]);
     }
 }
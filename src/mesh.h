@@ -1,29 +1,80 @@
 #pragma once
 
+#include <stdbool.h>
 #include "vector.h"
 #include "triangle.h"
+#include "material.h"
+#include "meshlet.h"
 
 #define N_CUBE_VERTICES 8
 #define N_CUBE_FACES (6 * 2) // 6 cube faces, 2 tri per face
 extern vec3_t cube_vertices[N_CUBE_VERTICES];
 extern face_t cube_faces[N_CUBE_FACES];
 
+// Edge between two vertices (0-based, a < b), shared by the faces around it
+typedef struct {
+	int a;
+	int b;
+} edge_t;
+
+/// ////////////////////////////////////////////////////////////////////////////
+// Levels of detail
+/// ////////////////////////////////////////////////////////////////////////////
+// Coarser copies of the faces, simplified at load time by collapsing edges
+// with the least quadric error (the mean squared distance to the planes of the
+// faces merged into a vertex, weighted by area), and cached in a .lod file
+// next to the obj. Collapses only move a vertex onto one of its neighbours, so
+// every level shares the mesh's vertices and normals. Vertices on uv seams
+// only move along the seam, together with their copy on the other side, and
+// material borders and open borders stay put. Each level keeps the edges and
+// meshlets of its own faces.
+
+// Coarser levels beside the full mesh, at 1/2, 1/4, 1/8 and 1/16 of its faces
+#define MESH_MAX_LODS 4
+
+typedef struct {
+	face_t* faces;		// dynamic array, over the mesh's vertices
+	edge_t* edges;
+	int* face_edges;
+	meshlet_t* meshlets;
+	int* meshlet_faces;
+	float error;		// square root of the largest collapse error, model space units
+} mesh_lod_t;
+
 /// ////////////////////////////////////////////////////////////////////////////
 // Dynamic size meshes
 /// ////////////////////////////////////////////////////////////////////////////
 typedef struct {
 	vec3_t* vertices; // dynamic array of vertices
+	vec3_t* normals;	// dynamic array of smooth vertex normals, parallel to vertices
 	face_t* faces;		// dynamic array of faces
-	vec3_t rotation;	// rotation with x, y, and z values
-	vec3_t scale;
-	vec3_t translation;
+	material_t* materials;	// dynamic array of materials, faces index into it
+	edge_t* edges;		// dynamic array of unique edges, for wireframes
+	int* face_edges;	// dynamic array, edges of face i at 3i (ab), 3i+1 (bc), 3i+2 (ca)
+	meshlet_t* meshlets;	// dynamic array of face clusters, see meshlet.h
+	int* meshlet_faces;	// dynamic array, face indices of the meshlets back to back
+	mesh_lod_t* lods;	// dynamic array of the coarser levels, lods[0] is level 1
+	vec3_t center;		// bounding sphere of the vertices, model space
+	float radius;
 } mesh_t;
 
 extern mesh_t mesh;   // the purpose of extern, which is to say "this is declared here, but defined elsewhere."
+                      // the asset model of the scene, placed by scene objects (see scene.h)
 
 void load_cube_mesh_data(void);
 
 void load_obj_file_data(char* filepath);
+bool load_obj_file_into(mesh_t* target, char* filepath);
+void free_mesh_data(mesh_t* target);
+material_t* get_mesh_material(mesh_t* target, int index);
+void compute_vertex_normals(mesh_t* target);
+void compute_mesh_edges(mesh_t* target);
+void compute_mesh_meshlets(mesh_t* target);
+void compute_lod_edges(mesh_t* target, mesh_lod_t* lod);
+void compute_lod_meshlets(mesh_t* target, mesh_lod_t* lod);
+void compute_mesh_lods(mesh_t* target, const char* cache_path);
+int get_mesh_lod_count(mesh_t* target);
+mesh_lod_t get_mesh_lod(mesh_t* target, int level);
 
 
 // read vertex lines "v", read in point values into a vertex "index"
@@ -0,0 +1,211 @@
+#include <math.h>
+#include <stdlib.h>
+#include "meshlet.h"
+#include "mesh.h"
+#include "array.h"
+#include "clipping.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// Clustering
+////////////////////////////////////////////////////////////////////////////////
+static bool is_face_in_range(face_t face, int num_vertices) {
+	return face.a >= 1 && face.a <= num_vertices &&
+		face.b >= 1 && face.b <= num_vertices &&
+		face.c >= 1 && face.c <= num_vertices;
+}
+
+// Unit normal with the winding of face_normal() in main.c, zero when degenerate
+static vec3_t unit_face_normal(mesh_t* target, face_t face) {
+	vec3_t a = target->vertices[face.a - 1];
+	vec3_t ab = vec3_sub(target->vertices[face.b - 1], a);
+	vec3_t ac = vec3_sub(target->vertices[face.c - 1], a);
+	vec3_t normal = vec3_cross(ab, ac);
+	float length = vec3_length(normal);
+	return length > 0 ? vec3_mul(normal, 1.0 / length) : vec3_new(0, 0, 0);
+}
+
+// Sphere around the vertices of the meshlet's faces, and the cone around
+// their normals. Degenerate faces have no normal to bound, so a meshlet with
+// one is never rejected as backfacing.
+static void compute_meshlet_bounds(mesh_t* target, mesh_lod_t* lod, meshlet_t* meshlet, const vec3_t* face_normals) {
+	int* faces = &lod->meshlet_faces[meshlet->first_face];
+	vec3_t min = vec3_new(INFINITY, INFINITY, INFINITY);
+	vec3_t max = vec3_new(-INFINITY, -INFINITY, -INFINITY);
+	vec3_t normal_sum = vec3_new(0, 0, 0);
+	bool has_degenerate = false;
+	for (int i = 0; i < meshlet->num_faces; i++) {
+		face_t face = lod->faces[faces[i]];
+		int indices[3] = { face.a - 1, face.b - 1, face.c - 1 };
+		for (int j = 0; j < 3; j++) {
+			vec3_t vertex = target->vertices[indices[j]];
+			min = vec3_new(fminf(min.x, vertex.x), fminf(min.y, vertex.y), fminf(min.z, vertex.z));
+			max = vec3_new(fmaxf(max.x, vertex.x), fmaxf(max.y, vertex.y), fmaxf(max.z, vertex.z));
+		}
+		vec3_t normal = face_normals[faces[i]];
+		has_degenerate |= vec3_length(normal) == 0;
+		normal_sum = vec3_add(normal_sum, normal);
+	}
+
+	meshlet->center = vec3_mul(vec3_add(min, max), 0.5);
+	meshlet->radius = 0;
+	for (int i = 0; i < meshlet->num_faces; i++) {
+		face_t face = lod->faces[faces[i]];
+		int indices[3] = { face.a - 1, face.b - 1, face.c - 1 };
+		for (int j = 0; j < 3; j++) {
+			float distance = vec3_length(vec3_sub(target->vertices[indices[j]], meshlet->center));
+			if (distance > meshlet->radius) meshlet->radius = distance;
+		}
+	}
+
+	meshlet->cone_axis = vec3_new(0, 0, 0);
+	meshlet->cone_cutoff = 1;
+	float length = vec3_length(normal_sum);
+	if (has_degenerate || length == 0) {
+		return;
+	}
+	meshlet->cone_axis = vec3_mul(normal_sum, 1.0 / length);
+	float min_dot = 1;
+	for (int i = 0; i < meshlet->num_faces; i++) {
+		float dot = vec3_dot(meshlet->cone_axis, face_normals[faces[i]]);
+		if (dot < min_dot) min_dot = dot;
+	}
+	// Normals past 90 degrees from the axis can face the camera from anywhere
+	if (min_dot > 0) {
+		meshlet->cone_cutoff = sqrtf(1 - min_dot * min_dot);
+	}
+}
+
+// Split the faces of a level into meshlets, kept in lod->meshlets with their
+// face indices in lod->meshlet_faces. Every face with in range vertices lands
+// in exactly one meshlet. Patches grow breadth first from the lowest face not
+// yet taken, through the level's edges, so compute those first.
+void compute_lod_meshlets(mesh_t* target, mesh_lod_t* lod) {
+	array_free(lod->meshlets);
+	array_free(lod->meshlet_faces);
+	lod->meshlets = NULL;
+	lod->meshlet_faces = NULL;
+
+	int num_vertices = array_length(target->vertices);
+	int num_faces = array_length(lod->faces);
+	int num_edges = array_length(lod->edges);
+	if (num_faces == 0) {
+		return;
+	}
+
+	// Faces around every edge, edge i's at edge_faces[edge_start[i]..edge_start[i + 1])
+	int* edge_start = calloc(num_edges + 1, sizeof(int));
+	int* edge_faces = malloc(sizeof(int) * num_faces * 3);
+	for (int i = 0; i < num_faces * 3; i++) {
+		if (lod->face_edges[i] >= 0) edge_start[lod->face_edges[i] + 1]++;
+	}
+	for (int i = 0; i < num_edges; i++) {
+		edge_start[i + 1] += edge_start[i];
+	}
+	int* edge_fill = malloc(sizeof(int) * (num_edges + 1));
+	for (int i = 0; i <= num_edges; i++) {
+		edge_fill[i] = edge_start[i];
+	}
+	for (int i = 0; i < num_faces * 3; i++) {
+		int edge = lod->face_edges[i];
+		if (edge >= 0) edge_faces[edge_fill[edge]++] = i / 3;
+	}
+	free(edge_fill);
+
+	vec3_t* face_normals = malloc(sizeof(vec3_t) * num_faces);
+	int* face_meshlet = malloc(sizeof(int) * num_faces);	// meshlet a face joined, -1 before
+	int* face_queued = malloc(sizeof(int) * num_faces);		// last meshlet that queued the face
+	int queue_capacity = num_faces;
+	int* queue = malloc(sizeof(int) * queue_capacity);
+	for (int i = 0; i < num_faces; i++) {
+		bool in_range = is_face_in_range(lod->faces[i], num_vertices);
+		face_normals[i] = in_range ? unit_face_normal(target, lod->faces[i]) : vec3_new(0, 0, 0);
+		face_meshlet[i] = in_range ? -1 : -2;
+		face_queued[i] = -1;
+	}
+
+	for (int seed = 0; seed < num_faces; seed++) {
+		if (face_meshlet[seed] != -1) {
+			continue;
+		}
+		int id = array_length(lod->meshlets);
+		meshlet_t meshlet = { .first_face = array_length(lod->meshlet_faces), .num_faces = 0 };
+		vec3_t normal_sum = vec3_new(0, 0, 0);
+
+		int head = 0, tail = 0;
+		queue[tail++] = seed;
+		face_queued[seed] = id;
+		while (head < tail && meshlet.num_faces < MESHLET_MAX_FACES) {
+			int face = queue[head++];
+			vec3_t axis = normal_sum;
+			if (vec3_length(axis) > 0) vec3_normalize(&axis);
+			if (meshlet.num_faces > 0 && vec3_dot(axis, face_normals[face]) < MESHLET_NORMAL_LIMIT) {
+				// Left for a later patch, or a later visit from another edge of this one
+				face_queued[face] = -1;
+				continue;
+			}
+			face_meshlet[face] = id;
+			array_push(lod->meshlet_faces, face);
+			meshlet.num_faces++;
+			normal_sum = vec3_add(normal_sum, face_normals[face]);
+
+			for (int j = 0; j < 3; j++) {
+				int edge = lod->face_edges[face * 3 + j];
+				if (edge < 0) continue;
+				for (int k = edge_start[edge]; k < edge_start[edge + 1]; k++) {
+					int neighbour = edge_faces[k];
+					if (face_meshlet[neighbour] == -1 && face_queued[neighbour] != id) {
+						if (tail == queue_capacity) {
+							queue_capacity *= 2;
+							queue = realloc(queue, sizeof(int) * queue_capacity);
+						}
+						face_queued[neighbour] = id;
+						queue[tail++] = neighbour;
+					}
+				}
+			}
+		}
+		compute_meshlet_bounds(target, lod, &meshlet, face_normals);
+		array_push(lod->meshlets, meshlet);
+	}
+
+	free(queue);
+	free(face_queued);
+	free(face_meshlet);
+	free(face_normals);
+	free(edge_faces);
+	free(edge_start);
+}
+
+// Meshlets of the full mesh
+void compute_mesh_meshlets(mesh_t* target) {
+	mesh_lod_t lod = get_mesh_lod(target, 0);
+	compute_lod_meshlets(target, &lod);
+	target->meshlets = lod.meshlets;
+	target->meshlet_faces = lod.meshlet_faces;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Culling, in view space where the camera is at the origin
+////////////////////////////////////////////////////////////////////////////////
+// Outside: the sphere is behind a frustrum plane. Backfacing: the angle
+// between the cone axis and the direction to any point of the sphere, plus
+// the cone's half angle, stays under 90 degrees, so every normal points away
+// from the camera wherever the face is in the sphere. With c the center and r
+// the radius that holds when dot(c, axis) > cutoff * |c| + r.
+int classify_meshlet(const meshlet_t* meshlet, mat4_t model_view, float scale, bool cull_backfaces) {
+	vec3_t center = vec3_from_vec4(mat4_mul_vec4(model_view, vec4_from_vec3(meshlet->center)));
+	float radius = meshlet->radius * scale;
+	if (is_sphere_outside_frustrum(center, radius)) {
+		return MESHLET_OUTSIDE;
+	}
+	if (cull_backfaces && meshlet->cone_cutoff < 1) {
+		vec4_t axis4 = vec4_from_vec3(meshlet->cone_axis);
+		axis4.w = 0;
+		vec3_t axis = vec3_from_vec4(mat4_mul_vec4(model_view, axis4));
+		vec3_normalize(&axis);
+		if (vec3_dot(center, axis) > meshlet->cone_cutoff * vec3_length(center) + radius) {
+			return MESHLET_BACKFACING;
+		}
+	}
+	return MESHLET_VISIBLE;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdbool.h>
+#include "vector.h"
+#include "matrix.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// Meshlets: clusters of up to MESHLET_MAX_FACES neighbouring faces
+////////////////////////////////////////////////////////////////////////////////
+// Built at load time by growing patches across shared edges, only taking
+// faces whose normal stays close to the patch's, so each meshlet has a tight
+// normal cone. Each keeps a bounding sphere and that cone in model space, so a
+// whole meshlet can be rejected with one test before any per-face work: when
+// its sphere is outside the frustrum, or when the cone faces away from every
+// point of the sphere, in which case all of its faces are backfaces.
+//
+// Both tests are conservative: a meshlet is only rejected when every one of
+// its faces would be clipped away or backface culled on its own.
+
+#define MESHLET_MAX_FACES 128
+
+// Smallest cosine between a face normal and the patch's average for the face
+// to join the patch
+#define MESHLET_NORMAL_LIMIT 0.7
+
+typedef struct {
+	int first_face;		// into the mesh's meshlet_faces
+	int num_faces;
+	vec3_t center;		// bounding sphere, model space
+	float radius;
+	vec3_t cone_axis;	// average face normal, model space
+	float cone_cutoff;	// sine of the cone's half angle, 1 when it cannot be backfacing
+} meshlet_t;
+
+enum meshlet_visibility {
+	MESHLET_VISIBLE,
+	MESHLET_BACKFACING,	// every face is a backface
+	MESHLET_OUTSIDE		// outside the view frustrum
+};
+
+// Classify a meshlet for a model view transform with rotation, translation and
+// a uniform scale. Backfaces are only tested when cull_backfaces is set.
+int classify_meshlet(const meshlet_t* meshlet, mat4_t model_view, float scale, bool cull_backfaces);
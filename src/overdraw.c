@@ -0,0 +1,154 @@
+#include <stdlib.h>
+#include <string.h>
+#include "overdraw.h"
+#include "display.h"
+#include "framebuffer.h"
+#include "text.h"
+
+// Heatmap colors for 1, 2, ... fragments per pixel, the last for that many or more
+static const uint32_t heatmap_colors[] = {
+	0xFF1830A0,	// 1 dark blue
+	0xFF0090E0,	// 2 light blue
+	0xFF00C060,	// 3 green
+	0xFFA0D000,	// 4 yellow green
+	0xFFFFD000,	// 5 yellow
+	0xFFFF8000,	// 6 orange
+	0xFFFF2000,	// 7 red
+	0xFFFFFFFF	// 8+ white
+};
+#define NUM_HEATMAP_COLORS (int)(sizeof(heatmap_colors) / sizeof(heatmap_colors[0]))
+
+#define OVERLAY_MARGIN 4
+#define SWATCH_SIZE 8
+
+static uint32_t* counters = NULL;
+static int counters_capacity = 0;
+static int counters_pitch = 0;
+static int counters_height = 0;
+static int overdraw_view = OVERDRAW_SHADED;
+static overdraw_stats_t stats;
+
+void set_overdraw_view(int view) {
+	overdraw_view = view;
+}
+
+int get_overdraw_view(void) {
+	return overdraw_view;
+}
+
+// Size the counters to the frame being rendered and zero them. Called after
+// the frame's render scale is set, before any overdraw kernel runs.
+void begin_overdraw_frame(void) {
+	framebuffer_t framebuffer = get_framebuffer();
+	int size = framebuffer.width * framebuffer.height;
+	if (size > counters_capacity) {
+		free(counters);
+		counters = (uint32_t*)malloc(sizeof(uint32_t) * size);
+		counters_capacity = counters != NULL ? size : 0;
+	}
+	counters_pitch = counters != NULL ? framebuffer.width : 0;
+	counters_height = counters != NULL ? framebuffer.height : 0;
+	if (counters != NULL) {
+		memset(counters, 0, sizeof(uint32_t) * size);
+	}
+}
+
+uint32_t* get_overdraw_buffer(void) {
+	return counters;
+}
+
+int get_overdraw_pitch(void) {
+	return counters_pitch;
+}
+
+static uint32_t heatmap_color(int count) {
+	return heatmap_colors[(count < NUM_HEATMAP_COLORS ? count : NUM_HEATMAP_COLORS) - 1];
+}
+
+// Paint the covered pixels and sum the statistics. The kernels prepared the
+// tiles of every covered pixel, so its color can be stored directly.
+void resolve_overdraw(void) {
+	memset(&stats, 0, sizeof(stats));
+	if (counters == NULL) {
+		return;
+	}
+	framebuffer_t framebuffer = get_framebuffer();
+	for (int y = 0; y < counters_height; y++) {
+		uint32_t* color_row = framebuffer_color_row(&framebuffer, y);
+		const uint32_t* counter_row = counters + (size_t)counters_pitch * y;
+		for (int x = 0; x < counters_pitch; x++) {
+			uint32_t counter = counter_row[x];
+			if (counter == 0) {
+				continue;
+			}
+			int tested = counter & 0xFFFF;
+			int shaded = counter >> 16;
+			stats.covered_pixels++;
+			stats.tested += tested;
+			stats.shaded += shaded;
+			int count = overdraw_view == OVERDRAW_TESTED ? tested : shaded;
+			if (count > 0) {
+				color_row[x] = heatmap_color(count);
+			}
+		}
+	}
+	if (stats.covered_pixels > 0) {
+		stats.depth_complexity = (float)stats.tested / stats.covered_pixels;
+		stats.overdraw = (float)stats.shaded / stats.covered_pixels;
+	}
+}
+
+overdraw_stats_t get_overdraw_stats(void) {
+	return stats;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Legend and statistics, bottom left
+////////////////////////////////////////////////////////////////////////////////
+void draw_overdraw_overlay(void) {
+	int scale = get_window_height() >= 600 ? 2 : 1;
+	int line_height = TEXT_ADVANCE_Y * scale;
+	int swatch = SWATCH_SIZE * scale;
+
+	char lines[2][64];
+	snprintf(lines[0], sizeof(lines[0]), "%s per pixel, 9 to switch",
+		overdraw_view == OVERDRAW_TESTED ? "depth tests" : "shaded");
+	snprintf(lines[1], sizeof(lines[1]), "covered %d  complexity %.2f  overdraw %.2f",
+		stats.covered_pixels, stats.depth_complexity, stats.overdraw);
+
+	int width = get_text_width(lines[1], scale);
+	int legend_width = NUM_HEATMAP_COLORS * (swatch + TEXT_ADVANCE_X * scale * 3);
+	if (legend_width > width) width = legend_width;
+	int height = 2 * line_height + swatch + 2;
+	int x = OVERLAY_MARGIN;
+	int y = get_window_height() - height - 2 * OVERLAY_MARGIN;
+	if (y < 0) {
+		return;
+	}
+	draw_fill_rect(0, y - OVERLAY_MARGIN, width + 2 * OVERLAY_MARGIN, height + 2 * OVERLAY_MARGIN, BLACK);
+
+	draw_text(x, y, lines[0], YELLOW, scale);
+	draw_text(x, y + line_height, lines[1], WHITE, scale);
+	y += 2 * line_height;
+	for (int i = 0; i < NUM_HEATMAP_COLORS; i++) {
+		char label[4];
+		snprintf(label, sizeof(label), i == NUM_HEATMAP_COLORS - 1 ? "%d+" : "%d", i + 1);
+		draw_fill_rect(x, y, swatch, swatch, heatmap_colors[i]);
+		draw_text(x + swatch + scale, y + (swatch - TEXT_GLYPH_HEIGHT * scale) / 2, label, WHITE, scale);
+		x += swatch + TEXT_ADVANCE_X * scale * 3;
+	}
+}
+
+void print_overdraw_stats(FILE* stream) {
+	fprintf(stream, "overdraw  covered %d px, %.2f tested and %.2f shaded per pixel\n",
+		stats.covered_pixels, stats.depth_complexity, stats.overdraw);
+	fflush(stream);
+}
+
+void free_overdraw_buffer(void) {
+	free(counters);
+	counters = NULL;
+	counters_capacity = 0;
+	counters_pitch = 0;
+	counters_height = 0;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// Overdraw and depth complexity visualization (RENDER_OVERDRAW)
+////////////////////////////////////////////////////////////////////////////////
+// The overdraw kernels depth test and depth write like the others but store no
+// color. Instead they count per pixel the fragments that were depth tested
+// (depth complexity) and the ones that passed and would have been shaded
+// (overdraw). resolve_overdraw() then paints the covered pixels as a heatmap of
+// one of the two counts and sums the frame statistics. With depth testing on,
+// the shaded count is what draw order changes; the tested count only changes
+// with culling.
+
+enum overdraw_view {
+	OVERDRAW_SHADED,	// fragments that passed the depth test
+	OVERDRAW_TESTED		// fragments that were depth tested
+};
+
+// Each counter is a uint32: tests in the low 16 bits, passes in the high 16
+#define OVERDRAW_TEST 1
+#define OVERDRAW_PASS (1 << 16)
+
+typedef struct {
+	int covered_pixels;		// pixels with at least one fragment
+	int64_t tested;
+	int64_t shaded;
+	float depth_complexity;	// tested fragments per covered pixel
+	float overdraw;			// shaded fragments per covered pixel, 1 is ideal
+} overdraw_stats_t;
+
+void set_overdraw_view(int view);
+int get_overdraw_view(void);
+
+void begin_overdraw_frame(void);
+uint32_t* get_overdraw_buffer(void);
+int get_overdraw_pitch(void);
+void resolve_overdraw(void);
+overdraw_stats_t get_overdraw_stats(void);
+
+void draw_overdraw_overlay(void);
+void print_overdraw_stats(FILE* stream);
+void free_overdraw_buffer(void);
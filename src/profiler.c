@@ -0,0 +1,214 @@
+#include <SDL2/SDL.h>
+#include <stdlib.h>
+#include <string.h>
+#include "profiler.h"
+#include "display.h"
+#include "text.h"
+#include "timing.h"
+
+#define NS_PER_MS 1000000.0
+
+static const char* stage_names[NUM_PROFILE_STAGES] = {
+	"frame", "transform", "clip", "project", "geometry", "sort", "raster", "resolve", "clear", "present"
+};
+
+static const char* counter_names[NUM_PROFILE_COUNTERS] = {
+	"tris in", "lod", "objs cull", "mlets cull", "culled", "clipped", "drawn", "px tested", "px written", "px resolved"
+};
+
+typedef struct {
+	uint64_t history[PROFILE_HISTORY];	// ring of finished frames
+} stage_timer_t;
+
+// A thread's share of the frame being profiled. The padding keeps threads
+// from writing to the same cache line.
+typedef struct {
+	uint64_t stage_ns[NUM_PROFILE_STAGES];
+	int64_t counters[NUM_PROFILE_COUNTERS];
+	uint8_t padding[64];
+} profile_slot_t;
+
+static bool profiling = false;
+static stage_timer_t stages[NUM_PROFILE_STAGES];
+static int history_next = 0;	// ring slot of the next finished frame
+static int history_length = 0;
+static profile_slot_t slots[PROFILE_MAX_THREADS];	// frame being profiled
+static int64_t last_counters[NUM_PROFILE_COUNTERS];	// last finished frame
+static SDL_TLSID slot_key = 0;	// slot + 1 of the calling thread, 0 for the main thread's
+
+// On the main thread, before any other thread starts
+void init_profiler(void) {
+	slot_key = SDL_TLSCreate();
+}
+
+// Slot the calling thread records into, 0 being the main thread's
+void set_profile_thread(int slot) {
+	if (slot_key != 0 && slot >= 0 && slot < PROFILE_MAX_THREADS) {
+		SDL_TLSSet(slot_key, (void*)(intptr_t)(slot + 1), NULL);
+	}
+}
+
+static profile_slot_t* get_thread_slot(void) {
+	intptr_t slot = slot_key != 0 ? (intptr_t)SDL_TLSGet(slot_key) : 0;
+	return &slots[slot > 0 ? slot - 1 : 0];
+}
+
+void set_profiling(bool enabled) {
+	if (enabled && !profiling) {
+		memset(stages, 0, sizeof(stages));
+		memset(slots, 0, sizeof(slots));
+		memset(last_counters, 0, sizeof(last_counters));
+		history_next = 0;
+		history_length = 0;
+	}
+	profiling = enabled;
+}
+
+bool is_profiling_enabled(void) {
+	return profiling;
+}
+
+// Start time for profile_end, 0 while profiling is off
+uint64_t profile_begin(void) {
+	return profiling ? get_time_ns() : 0;
+}
+
+void profile_end(int stage, uint64_t start) {
+	if (start == 0 || !profiling) {
+		return;
+	}
+	get_thread_slot()->stage_ns[stage] += get_time_ns() - start;
+}
+
+void profile_count(int counter, int64_t amount) {
+	if (profiling) {
+		get_thread_slot()->counters[counter] += amount;
+	}
+}
+
+// Sum the slots into the history, once no other thread records into them
+void end_profile_frame(void) {
+	if (!profiling) {
+		return;
+	}
+	memset(last_counters, 0, sizeof(last_counters));
+	for (int i = 0; i < NUM_PROFILE_STAGES; i++) {
+		stages[i].history[history_next] = 0;
+	}
+	for (int t = 0; t < PROFILE_MAX_THREADS; t++) {
+		for (int i = 0; i < NUM_PROFILE_STAGES; i++) {
+			stages[i].history[history_next] += slots[t].stage_ns[i];
+		}
+		for (int i = 0; i < NUM_PROFILE_COUNTERS; i++) {
+			last_counters[i] += slots[t].counters[i];
+		}
+	}
+	memset(slots, 0, sizeof(slots));
+	history_next = (history_next + 1) % PROFILE_HISTORY;
+	if (history_length < PROFILE_HISTORY) {
+		history_length++;
+	}
+}
+
+const char* get_profile_stage_name(int stage) {
+	return stage_names[stage];
+}
+
+const char* get_profile_counter_name(int counter) {
+	return counter_names[counter];
+}
+
+static int compare_u64(const void* a, const void* b) {
+	uint64_t left = *(const uint64_t*)a;
+	uint64_t right = *(const uint64_t*)b;
+	return left < right ? -1 : left > right;
+}
+
+profile_stats_t get_profile_stats(int stage) {
+	profile_stats_t stats = { 0, 0, 0 };
+	if (history_length == 0) {
+		return stats;
+	}
+	uint64_t sorted[PROFILE_HISTORY];
+	memcpy(sorted, stages[stage].history, sizeof(uint64_t) * history_length);
+	qsort(sorted, history_length, sizeof(uint64_t), compare_u64);
+
+	uint64_t sum = 0;
+	for (int i = 0; i < history_length; i++) {
+		sum += sorted[i];
+	}
+	int p99_index = (history_length * 99 + 99) / 100 - 1;
+	stats.min_ms = sorted[0] / NS_PER_MS;
+	stats.avg_ms = sum / NS_PER_MS / history_length;
+	stats.p99_ms = sorted[p99_index] / NS_PER_MS;
+	return stats;
+}
+
+// Counter value of the last finished frame
+int64_t get_profile_counter(int counter) {
+	return last_counters[counter];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Report, on screen and as text
+////////////////////////////////////////////////////////////////////////////////
+#define OVERLAY_MARGIN 4
+#define OVERLAY_COLUMNS 30
+
+static void format_header_line(char* line, size_t size) {
+	snprintf(line, size, "%-9s %6s %6s %6s", "stage ms", "min", "avg", "p99");
+}
+
+static void format_stage_line(char* line, size_t size, int stage) {
+	profile_stats_t stats = get_profile_stats(stage);
+	snprintf(line, size, "%-9s %6.2f %6.2f %6.2f", stage_names[stage], stats.min_ms, stats.avg_ms, stats.p99_ms);
+}
+
+static void format_counter_line(char* line, size_t size, int counter) {
+	snprintf(line, size, "%-10s %lld", counter_names[counter], (long long)last_counters[counter]);
+}
+
+// Stats table in the top left corner of the color buffer, drawn last so it is
+// on top of the frame
+void draw_profile_overlay(void) {
+	if (!profiling) {
+		return;
+	}
+	int scale = get_window_height() >= 600 ? 2 : 1;
+	int line_height = TEXT_ADVANCE_Y * scale;
+	int num_lines = 2 + NUM_PROFILE_STAGES + NUM_PROFILE_COUNTERS;
+	draw_fill_rect(0, 0,
+		OVERLAY_COLUMNS * TEXT_ADVANCE_X * scale + 2 * OVERLAY_MARGIN,
+		num_lines * line_height + 2 * OVERLAY_MARGIN, BLACK);
+
+	char line[64];
+	int x = OVERLAY_MARGIN;
+	int y = OVERLAY_MARGIN;
+	format_header_line(line, sizeof(line));
+	draw_text(x, y, line, YELLOW, scale);
+	y += line_height;
+	for (int i = 0; i < NUM_PROFILE_STAGES; i++, y += line_height) {
+		format_stage_line(line, sizeof(line), i);
+		draw_text(x, y, line, WHITE, scale);
+	}
+	y += line_height;
+	for (int i = 0; i < NUM_PROFILE_COUNTERS; i++, y += line_height) {
+		format_counter_line(line, sizeof(line), i);
+		draw_text(x, y, line, WHITE, scale);
+	}
+}
+
+void print_profile_report(FILE* stream) {
+	char line[64];
+	format_header_line(line, sizeof(line));
+	fprintf(stream, "%s  (last %d frames)\n", line, history_length);
+	for (int i = 0; i < NUM_PROFILE_STAGES; i++) {
+		format_stage_line(line, sizeof(line), i);
+		fprintf(stream, "%s\n", line);
+	}
+	for (int i = 0; i < NUM_PROFILE_COUNTERS; i++) {
+		format_counter_line(line, sizeof(line), i);
+		fprintf(stream, "%s\n", line);
+	}
+	fflush(stream);
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// Per-stage frame profiler
+////////////////////////////////////////////////////////////////////////////////
+// A stage is timed between profile_begin() and profile_end(), or over a block
+// with PROFILE_SCOPE. Stages entered many times a frame (clipping runs once
+// per face) report their sum for the frame. end_profile_frame() files the
+// frame into a history of the last PROFILE_HISTORY frames for min/avg/p99.
+// Counters are sums over one frame. While profiling is off the timers do not
+// read the clock and the counters are not kept.
+//
+// Threads working on the frame (see jobs.h) record into their own slot,
+// picked with set_profile_thread(), and the slots are added up when the frame
+// ends: stages run in parallel report the time summed over the threads. Job
+// workers use their worker index. With a single worker the loader thread is
+// worker 1 and records into slot 1, which the frame's jobs never use.
+
+#define PROFILE_MAX_THREADS 16
+
+#define PROFILE_HISTORY 120
+
+enum profile_stage {
+	PROFILE_FRAME,		// whole frame, from the end of the pacing wait
+	PROFILE_TRANSFORM,	// vertex transform, lighting and backface culling
+	PROFILE_CLIP,		// frustrum clipping
+	PROFILE_PROJECT,	// projection and triangle assembly
+	PROFILE_GEOMETRY,	// whole geometry stage, wall clock, the three above summed over threads
+	PROFILE_SORT,		// material binning
+	PROFILE_RASTER,		// triangles, lines and vertex markers
+	PROFILE_RESOLVE,	// visibility buffer shading, see visibility.h
+	PROFILE_CLEAR,		// lazy tile clears, also part of raster and present
+	PROFILE_PRESENT,	// render_color_buffer
+	NUM_PROFILE_STAGES
+};
+
+enum profile_counter {
+	COUNTER_TRIANGLES_IN,		// faces of the drawn level entering the pipeline
+	COUNTER_LOD_LEVEL,			// levels of detail drawn summed over the objects, 0 is the full mesh
+	COUNTER_OBJECTS_CULLED,		// scene objects outside the frustrum, skipped whole
+	COUNTER_MESHLETS_CULLED,	// meshlets rejected whole, their faces count as culled or clipped
+	COUNTER_TRIANGLES_CULLED,	// faces dropped as backfaces
+	COUNTER_TRIANGLES_CLIPPED,	// faces the frustrum cut or removed
+	COUNTER_TRIANGLES_DRAWN,	// triangles handed to the rasterizer
+	COUNTER_PIXELS_TESTED,		// pixels covered, before the depth test
+	COUNTER_PIXELS_WRITTEN,		// pixels that passed and were stored
+	COUNTER_PIXELS_RESOLVED,	// pixels shaded from the visibility buffer
+	NUM_PROFILE_COUNTERS
+};
+
+typedef struct {
+	float min_ms;
+	float avg_ms;
+	float p99_ms;
+} profile_stats_t;
+
+void init_profiler(void);
+void set_profile_thread(int slot);
+void set_profiling(bool enabled);
+bool is_profiling_enabled(void);
+
+uint64_t profile_begin(void);
+void profile_end(int stage, uint64_t start);
+void profile_count(int counter, int64_t amount);
+void end_profile_frame(void);
+
+// Time the statement or block that follows as stage. The block runs inside a
+// one-pass loop of its own: break and continue in it end the scope (still
+// timed), never a loop around it, and return or goto out of it skip the
+// profile_end. Use profile_begin/profile_end for blocks that need those.
+#define PROFILE_SCOPE(stage) \
+	for (uint64_t profile_start_ = profile_begin(), profile_once_ = 1; profile_once_; profile_once_ = 0, profile_end((stage), profile_start_)) \
+		for (int profile_body_ = 1; profile_body_; profile_body_ = 0)
+
+const char* get_profile_stage_name(int stage);
+const char* get_profile_counter_name(int counter);
+profile_stats_t get_profile_stats(int stage);
+int64_t get_profile_counter(int counter);
+
+void draw_profile_overlay(void);
+void print_profile_report(FILE* stream);
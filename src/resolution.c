@@ -0,0 +1,96 @@
+#include <math.h>
+#include "resolution.h"
+
+// Frames run over above OVER of the target and count as under below UNDER
+#define RESOLUTION_OVER_BUDGET 0.95
+#define RESOLUTION_UNDER_BUDGET 0.75
+#define RESOLUTION_FRAMES_TO_DROP 3
+#define RESOLUTION_FRAMES_TO_RAISE 30
+#define RESOLUTION_RAISE_STEP 0.05
+#define RESOLUTION_MAX_DROP 0.25
+
+typedef struct {
+	bool enabled;
+	float target_ms;
+	float min_scale;
+	float max_scale;
+	float scale;
+	float average_ms;	// exponential moving average of the frame time
+	int frames_over;
+	int frames_under;
+} resolution_scaler_t;
+
+static resolution_scaler_t scaler = {
+	.enabled = false,
+	.target_ms = 16,
+	.min_scale = 1,
+	.max_scale = 1,
+	.scale = 1,
+	.average_ms = 0,
+	.frames_over = 0,
+	.frames_under = 0
+};
+
+void init_resolution_scaling(float target_ms, float min_scale, float max_scale) {
+	scaler.enabled = true;
+	scaler.target_ms = target_ms;
+	scaler.min_scale = min_scale;
+	scaler.max_scale = max_scale < min_scale ? min_scale : max_scale;
+	scaler.scale = scaler.max_scale;
+	scaler.average_ms = 0;
+	scaler.frames_over = 0;
+	scaler.frames_under = 0;
+}
+
+// Disabling renders at the maximum scale again
+void set_resolution_scaling(bool enabled) {
+	scaler.enabled = enabled;
+	scaler.scale = scaler.max_scale;
+	scaler.average_ms = 0;
+	scaler.frames_over = 0;
+	scaler.frames_under = 0;
+}
+
+bool is_resolution_scaling_enabled(void) {
+	return scaler.enabled;
+}
+
+// Returns the render scale for the next frame
+float update_resolution_scale(float frame_ms) {
+	if (!scaler.enabled) {
+		return scaler.scale;
+	}
+
+	scaler.average_ms = scaler.average_ms == 0 ? frame_ms : scaler.average_ms * 0.8 + frame_ms * 0.2;
+
+	if (scaler.average_ms > scaler.target_ms * RESOLUTION_OVER_BUDGET) {
+		scaler.frames_over++;
+		scaler.frames_under = 0;
+	} else if (scaler.average_ms < scaler.target_ms * RESOLUTION_UNDER_BUDGET) {
+		scaler.frames_under++;
+		scaler.frames_over = 0;
+	} else {
+		scaler.frames_over = 0;
+		scaler.frames_under = 0;
+	}
+
+	if (scaler.frames_over >= RESOLUTION_FRAMES_TO_DROP) {
+		// Raster cost goes with the pixel count, the square of the scale: aim
+		// for the middle of the dead band in one step
+		float target = scaler.target_ms * (RESOLUTION_OVER_BUDGET + RESOLUTION_UNDER_BUDGET) / 2;
+		float scale = scaler.scale * sqrtf(target / scaler.average_ms);
+		if (scale < scaler.scale - RESOLUTION_MAX_DROP) scale = scaler.scale - RESOLUTION_MAX_DROP;
+		scaler.scale = scale;
+		scaler.frames_over = 0;
+		// Start measuring the new scale afresh
+		scaler.average_ms = 0;
+	} else if (scaler.frames_under >= RESOLUTION_FRAMES_TO_RAISE) {
+		scaler.scale += RESOLUTION_RAISE_STEP;
+		scaler.frames_under = 0;
+		scaler.average_ms = 0;
+	}
+
+	if (scaler.scale < scaler.min_scale) scaler.scale = scaler.min_scale;
+	if (scaler.scale > scaler.max_scale) scaler.scale = scaler.max_scale;
+	return scaler.scale;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdbool.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// Dynamic resolution scaling
+////////////////////////////////////////////////////////////////////////////////
+// Fed the measured CPU time of every frame, picks the render scale that keeps
+// it under the frame time target. It drops resolution quickly when frames run
+// over and raises it slowly once they are comfortably under, with a dead band
+// in between so the scale does not oscillate.
+
+void init_resolution_scaling(float target_ms, float min_scale, float max_scale);
+void set_resolution_scaling(bool enabled);
+bool is_resolution_scaling_enabled(void);
+float update_resolution_scale(float frame_ms);
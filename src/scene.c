@@ -0,0 +1,280 @@
+#include <stdio.h>
+#include <string.h>
+#include "scene.h"
+#include "array.h"
+#include "material.h"
+#include "jobs.h"
+
+#define M_PI 3.14159265358979323846
+#define DEGREES (M_PI / 180.0)
+
+static scene_model_t* models = NULL;	// models[0] is the asset model
+static scene_object_t* objects = NULL;
+
+// Material slots: model m's materials start at material_bases[m]
+static int* material_bases = NULL;
+static int* material_counts = NULL;
+static texture_t** material_textures = NULL;
+static int num_material_slots = 0;
+
+static void free_scene_models(void) {
+	for (int i = 0; i < array_length(models); i++) {
+		if (i != SCENE_ASSET_MODEL) {
+			free_mesh_data(&models[i].mesh);
+			free_texture(&models[i].texture);
+		}
+	}
+	array_free(models);
+	models = NULL;
+	scene_model_t asset = { .name = "asset" };
+	array_push(models, asset);
+}
+
+static void add_object(int model, vec3_t translation, vec3_t rotation, float scale, vec3_t spin) {
+	scene_object_t object = {
+		.model = model,
+		.scale = vec3_new(scale, scale, scale),
+		.rotation = rotation,
+		.translation = translation,
+		.spin = spin,
+		.start_rotation = rotation,
+		.previous_rotation = rotation,
+		.world_matrix = mat4_identity()
+	};
+	array_push(objects, object);
+}
+
+// One object drawing the asset model, replacing the scene
+void init_default_scene(vec3_t translation, vec3_t spin) {
+	free_scene_models();
+	array_free(objects);
+	objects = NULL;
+	add_object(SCENE_ASSET_MODEL, translation, vec3_new(0, 0, 0), 1.0, spin);
+}
+
+static int find_model(char* name) {
+	for (int i = 0; i < array_length(models); i++) {
+		if (strcmp(models[i].name, name) == 0) return i;
+	}
+	return -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Scene files
+////////////////////////////////////////////////////////////////////////////////
+// Model files of a scene, read once the whole file is parsed: each obj and
+// each png is a job. Model i + 1 loads from model_loads[i].
+typedef struct {
+	char obj_path[MAX_MATERIAL_PATH];
+	char png_path[MAX_MATERIAL_PATH];
+	int line_number;
+	bool mesh_loaded;
+	bool texture_loaded;
+} model_load_t;
+
+static void add_scene_model(model_load_t** loads, char* scene_path, char* name, char* obj_name, int line_number) {
+	scene_model_t model = { 0 };
+	snprintf(model.name, MAX_SCENE_NAME, "%s", name);
+	array_push(models, model);
+
+	model_load_t load = { .line_number = line_number };
+	path_next_to(load.obj_path, MAX_MATERIAL_PATH, scene_path, obj_name);
+	snprintf(load.png_path, MAX_MATERIAL_PATH, "%s", load.obj_path);
+	char* extension = strrchr(load.png_path, '.');
+	if (extension != NULL && (size_t)(extension - load.png_path) + 5 <= MAX_MATERIAL_PATH) {
+		strcpy(extension, ".png");
+	}
+	array_push(*loads, load);
+}
+
+// Even jobs load a model's obj, odd ones its png
+static void load_model_file(int index, int worker, void* data) {
+	model_load_t* load = &((model_load_t*)data)[index / 2];
+	scene_model_t* model = &models[index / 2 + 1];
+	if (index % 2 == 0) {
+		load->mesh_loaded = load_obj_file_into(&model->mesh, load->obj_path);
+	} else {
+		load->texture_loaded = load_png_texture(&model->texture, load->png_path);
+	}
+}
+
+// Load every model in parallel, the brick texture standing in for a missing png
+static bool load_scene_models(model_load_t* loads, char* scene_path) {
+	job_counter_t counter = { { 0 } };
+	run_jobs("load model", array_length(loads) * 2, load_model_file, loads, &counter);
+	wait_for_jobs(&counter);
+
+	bool loaded = true;
+	for (int i = 0; i < array_length(loads); i++) {
+		scene_model_t* model = &models[i + 1];
+		if (!loads[i].texture_loaded) {
+			model->texture = get_placeholder_texture();
+		}
+		if (!loads[i].mesh_loaded) {
+			fprintf(stderr, "Error in scene file %s line %d: could not load %s.\n", scene_path, loads[i].line_number, loads[i].obj_path);
+			loaded = false;
+		}
+	}
+	return loaded;
+}
+
+// Replace the scene with the one in a scene file. On errors the scene is left
+// empty and false is returned.
+bool load_scene_file(char* path) {
+	FILE* file = fopen(path, "r");
+	if (file == NULL) {
+		fprintf(stderr, "Error opening scene file %s.\n", path);
+		return false;
+	}
+	free_scene_models();
+	array_free(objects);
+	objects = NULL;
+
+	model_load_t* loads = NULL;
+	char line[1024];
+	int line_number = 0;
+	bool loaded = true;
+	while (loaded && fgets(line, sizeof(line), file)) {
+		line_number++;
+		char directive[16];
+		char name[MAX_SCENE_NAME];
+		char obj_name[MAX_MATERIAL_PATH];
+		if (sscanf(line, "%15s", directive) != 1 || directive[0] == '#') {
+			continue;
+		}
+		if (strcmp(directive, "model") == 0) {
+			loaded = sscanf(line, "model %63s %255s", name, obj_name) == 2 && find_model(name) < 0;
+			if (loaded) {
+				add_scene_model(&loads, path, name, obj_name, line_number);
+			}
+		} else if (strcmp(directive, "object") == 0) {
+			float v[10] = { 0, 0, 0, 0, 0, 0, 1, 0, 0, 0 };
+			int count = sscanf(line, "object %63s %f %f %f %f %f %f %f %f %f %f",
+				name, &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7], &v[8], &v[9]) - 1;
+			int model = count >= 0 ? find_model(name) : -1;
+			loaded = model >= 0 && (count == 3 || count == 6 || count == 7 || count == 10);
+			if (loaded) {
+				vec3_t rotation = vec3_mul(vec3_new(v[3], v[4], v[5]), DEGREES);
+				vec3_t spin = vec3_mul(vec3_new(v[7], v[8], v[9]), DEGREES);
+				add_object(model, vec3_new(v[0], v[1], v[2]), rotation, v[6], spin);
+			}
+		} else {
+			loaded = false;
+		}
+		if (!loaded) {
+			fprintf(stderr, "Error in scene file %s line %d: %s", path, line_number, line);
+		}
+	}
+	fclose(file);
+	if (loaded) {
+		loaded = load_scene_models(loads, path);
+	}
+	array_free(loads);
+	if (!loaded) {
+		free_scene();
+	}
+	return loaded;
+}
+
+void free_scene(void) {
+	free_scene_models();
+	array_free(models);
+	array_free(objects);
+	array_free(material_bases);
+	array_free(material_counts);
+	array_free(material_textures);
+	models = NULL;
+	objects = NULL;
+	material_bases = NULL;
+	material_counts = NULL;
+	material_textures = NULL;
+	num_material_slots = 0;
+}
+
+int get_scene_object_count(void) {
+	return array_length(objects);
+}
+
+const scene_object_t* get_scene_object(int index) {
+	return &objects[index];
+}
+
+mesh_t* get_scene_model_mesh(int model) {
+	return model == SCENE_ASSET_MODEL ? &mesh : &models[model].mesh;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Animation, one fixed simulation step at a time
+////////////////////////////////////////////////////////////////////////////////
+void animate_scene(float dt) {
+	for (int i = 0; i < array_length(objects); i++) {
+		scene_object_t* object = &objects[i];
+		object->previous_rotation = object->rotation;
+		object->rotation = vec3_add(object->rotation, vec3_mul(object->spin, dt));
+	}
+}
+
+void reset_scene_animation(void) {
+	for (int i = 0; i < array_length(objects); i++) {
+		objects[i].rotation = objects[i].start_rotation;
+		objects[i].previous_rotation = objects[i].start_rotation;
+	}
+}
+
+// World matrices at alpha between the last two simulation steps, scale then
+// rotate then translate: [T]*[Rx]*[Ry]*[Rz]*[S]*v
+void update_scene_world_matrices(float alpha) {
+	for (int i = 0; i < array_length(objects); i++) {
+		scene_object_t* object = &objects[i];
+		vec3_t rotation = vec3_add(object->previous_rotation,
+			vec3_mul(vec3_sub(object->rotation, object->previous_rotation), alpha));
+		mat4_t world_matrix = mat4_identity();
+		world_matrix = mat4_mul_mat4(mat4_make_scale(object->scale.x, object->scale.y, object->scale.z), world_matrix);
+		world_matrix = mat4_mul_mat4(mat4_make_rotation_z(rotation.z), world_matrix);
+		world_matrix = mat4_mul_mat4(mat4_make_rotation_y(rotation.y), world_matrix);
+		world_matrix = mat4_mul_mat4(mat4_make_rotation_x(rotation.x), world_matrix);
+		world_matrix = mat4_mul_mat4(mat4_make_translation(object->translation.x, object->translation.y, object->translation.z), world_matrix);
+		object->world_matrix = world_matrix;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Material slots
+////////////////////////////////////////////////////////////////////////////////
+// Number the materials of every model, each model getting at least one slot
+// for its default material. Run every frame, since the asset can be swapped.
+// A material without a diffuse map samples its model's texture.
+void update_scene_materials(void) {
+	int num_models = array_length(models);
+	models[SCENE_ASSET_MODEL].texture = get_mesh_texture();
+	material_bases = array_reserve(material_bases, num_models, sizeof(int));
+	material_counts = array_reserve(material_counts, num_models, sizeof(int));
+	num_material_slots = 0;
+	for (int m = 0; m < num_models; m++) {
+		mesh_t* model_mesh = get_scene_model_mesh(m);
+		int count = array_length(model_mesh->materials);
+		material_bases[m] = num_material_slots;
+		material_counts[m] = count > 0 ? count : 1;
+		for (int i = 0; i < material_counts[m]; i++) {
+			material_t* material = get_mesh_material(model_mesh, i);
+			texture_t* texture = material != NULL && material->texture.texels != NULL ? &material->texture : &models[m].texture;
+			if (num_material_slots >= array_length(material_textures)) {
+				material_textures = array_hold(material_textures, 1, sizeof(texture_t*));
+			}
+			material_textures[num_material_slots++] = texture;
+		}
+	}
+}
+
+int get_scene_material_count(void) {
+	return num_material_slots;
+}
+
+// Slot of a model's material, its default material's for out of range indices
+int get_scene_material_slot(int model, int material) {
+	return material_bases[model] + (material >= 0 && material < material_counts[model] ? material : 0);
+}
+
+texture_t* get_scene_material_texture(int slot) {
+	return slot >= 0 && slot < num_material_slots ? material_textures[slot] : &models[SCENE_ASSET_MODEL].texture;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdbool.h>
+#include "mesh.h"
+#include "texture.h"
+#include "matrix.h"
+#include "vector.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// Scene: objects placed in the world, each an instance of a shared model
+////////////////////////////////////////////////////////////////////////////////
+// A model is a mesh with its texture, the png next to the obj. Model 0 is the
+// asset the renderer started with, cycled with the L key: its data is the
+// global mesh and mesh texture. Scene files add more models. Any number of
+// objects can draw the same model, each with its own transform, and
+// update_scene_world_matrices() computes an object's world matrix once a
+// frame for all of its faces.
+//
+// Scene files hold one directive per line, # starts a comment:
+//   model NAME PATH.obj
+//   object NAME X Y Z [RX RY RZ [SCALE [SPIN_X SPIN_Y SPIN_Z]]]
+// Obj paths are relative to the scene file, rotations are in degrees and
+// spins in degrees per second. The name "asset" is model 0.
+//
+// The materials of every model are numbered one after the other into material
+// slots, so triangles of all objects sort and bind textures together.
+
+#define SCENE_ASSET_MODEL 0
+#define MAX_SCENE_NAME 64
+
+typedef struct {
+	char name[MAX_SCENE_NAME];
+	mesh_t mesh;		// unused for the asset model, which is the global mesh
+	texture_t texture;
+} scene_model_t;
+
+typedef struct {
+	int model;
+	vec3_t scale;
+	vec3_t rotation;
+	vec3_t translation;
+	vec3_t spin;				// radians per second
+	vec3_t start_rotation;		// restored by reset_scene_animation()
+	vec3_t previous_rotation;	// at the previous simulation step
+	mat4_t world_matrix;		// of the frame being built
+} scene_object_t;
+
+void init_default_scene(vec3_t translation, vec3_t spin);
+bool load_scene_file(char* path);
+void free_scene(void);
+
+int get_scene_object_count(void);
+const scene_object_t* get_scene_object(int index);
+mesh_t* get_scene_model_mesh(int model);
+
+void animate_scene(float dt);
+void reset_scene_animation(void);
+void update_scene_world_matrices(float alpha);
+
+void update_scene_materials(void);
+int get_scene_material_count(void);
+int get_scene_material_slot(int model, int material);
+texture_t* get_scene_material_texture(int slot);
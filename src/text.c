@@ -0,0 +1,51 @@
+#include <string.h>
+#include "display.h"
+#include "text.h"
+
+// Glyphs for ASCII 32..95, row-major from the top left: bit 14 is the top
+// left pixel, bit 0 the bottom right
+static const uint16_t font_glyphs[64] = {
+	0x0000, 0x2482, 0x0000, 0x0000, 0x0000, 0x52A5, 0x0000, 0x0000,  //  !"#$%&'
+	0x2922, 0x224A, 0x0AA8, 0x05D0, 0x0014, 0x01C0, 0x0002, 0x12A4,  // ()*+,-./
+	0x7B6F, 0x2C97, 0x73E7, 0x73CF, 0x5BC9, 0x79CF, 0x79EF, 0x7249,  // 01234567
+	0x7BEF, 0x7BCF, 0x0410, 0x0000, 0x1511, 0x0E38, 0x4454, 0x72C2,  // 89:;<=>?
+	0x0000, 0x2BED, 0x6BAE, 0x3923, 0x6B6E, 0x79A7, 0x79A4, 0x396B,  // @ABCDEFG
+	0x5BED, 0x7497, 0x126A, 0x5BAD, 0x4927, 0x5FED, 0x6B6D, 0x2B6A,  // HIJKLMNO
+	0x6BA4, 0x2B73, 0x6BAD, 0x388E, 0x7492, 0x5B6F, 0x5B6A, 0x5BFD,  // PQRSTUVW
+	0x5AAD, 0x5A92, 0x72A7, 0x6926, 0x0000, 0x324B, 0x0000, 0x0007,  // XYZ[\]^_
+};
+
+static uint16_t glyph_bits(char c) {
+    if (c >= 'a' && c <= 'z') c -= 'a' - 'A';
+    if (c < 32 || c > 95) return 0;
+    return font_glyphs[c - 32];
+}
+
+// Draw a line of text with its top left at x,y, each font pixel scaled to a
+// scale x scale block. Clipped to the scissor through draw_pixel.
+void draw_text(int x, int y, const char* text, uint32_t color, int scale) {
+    int width = get_text_width(text, scale);
+    if (width == 0) {
+        return;
+    }
+    prepare_framebuffer_rect(x, y, x + width - 1, y + TEXT_GLYPH_HEIGHT * scale - 1);
+
+    for (; *text; text++, x += TEXT_ADVANCE_X * scale) {
+        uint16_t bits = glyph_bits(*text);
+        for (int row = 0; row < TEXT_GLYPH_HEIGHT; row++) {
+            for (int column = 0; column < TEXT_GLYPH_WIDTH; column++) {
+                if (!(bits & (1 << (14 - row * TEXT_GLYPH_WIDTH - column)))) continue;
+                for (int i = 0; i < scale; i++) {
+                    for (int j = 0; j < scale; j++) {
+                        draw_pixel(x + column * scale + j, y + row * scale + i, color);
+                    }
+                }
+            }
+        }
+    }
+}
+
+int get_text_width(const char* text, int scale) {
+    int length = strlen(text);
+    return length > 0 ? (length * TEXT_ADVANCE_X - 1) * scale : 0;
+}
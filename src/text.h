@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdint.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// Bitmap text for debug overlays: a 3x5 pixel font, upper case ASCII only
+// (lower case is drawn as upper case)
+////////////////////////////////////////////////////////////////////////////////
+#define TEXT_GLYPH_WIDTH 3
+#define TEXT_GLYPH_HEIGHT 5
+
+// Pixels from one glyph or line to the next, at scale 1
+#define TEXT_ADVANCE_X (TEXT_GLYPH_WIDTH + 1)
+#define TEXT_ADVANCE_Y (TEXT_GLYPH_HEIGHT + 2)
+
+void draw_text(int x, int y, const char* text, uint32_t color, int scale);
+int get_text_width(const char* text, int scale);
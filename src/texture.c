@@ -10,17 +10,72 @@ upng_t *png_texture = NULL;
 uint32_t *mesh_texture = NULL;
 
 void load_png_texture_data(char *filename) {
-    png_texture = upng_new_from_file(filename);
-    if (png_texture != NULL) {
-        upng_decode(png_texture);
-        if (upng_get_error(png_texture) == UPNG_EOK) {
-            mesh_texture = (uint32_t *)upng_get_buffer(png_texture);
-            texture_width = upng_get_width(png_texture);
-            texture_height = upng_get_height(png_texture);
-        }
+    texture_t texture;
+    if (load_png_texture(&texture, filename)) {
+        set_mesh_texture(texture);
     }
 }
 
+// Decode a png into target as 0xAARRGGBB texels without touching the globals,
+// safe to call off the main thread
+bool load_png_texture(texture_t *target, char *filename) {
+    target->png = upng_new_from_file(filename);
+    target->texels = NULL;
+    target->width = 0;
+    target->height = 0;
+    if (target->png == NULL) {
+        return false;
+    }
+    upng_decode_argb(target->png);
+    if (upng_get_error(target->png) != UPNG_EOK) {
+        fprintf(stderr, "Error decoding png %s (upng error %d).\n", filename, upng_get_error(target->png));
+        upng_free(target->png);
+        target->png = NULL;
+        return false;
+    }
+    target->texels = (uint32_t *)upng_get_buffer(target->png);
+    target->width = upng_get_width(target->png);
+    target->height = upng_get_height(target->png);
+    return true;
+}
+
+// Make texture the one sampled by the rasterizer; the caller keeps ownership of the previous one
+void set_mesh_texture(texture_t texture) {
+    png_texture = texture.png;
+    mesh_texture = texture.texels;
+    texture_width = texture.width;
+    texture_height = texture.height;
+}
+
+texture_t get_mesh_texture(void) {
+    texture_t texture = {
+        .png = png_texture,
+        .texels = mesh_texture,
+        .width = texture_width,
+        .height = texture_height
+    };
+    return texture;
+}
+
+// The builtin brick texture, static data that free_texture() leaves alone
+texture_t get_placeholder_texture(void) {
+    texture_t texture = {
+        .png = NULL,
+        .texels = (uint32_t *)REDBRICK_TEXTURE,
+        .width = 64,
+        .height = 64
+    };
+    return texture;
+}
+
+void free_texture(texture_t *texture) {
+    if (texture->png != NULL) {
+        upng_free(texture->png);
+    }
+    texture->png = NULL;
+    texture->texels = NULL;
+}
+
 const uint8_t REDBRICK_TEXTURE[] = {
     // uv test, white row of pixels
     /* 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x38, 0x38, 0x38, 0xff,
@@ -1,12 +1,22 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include "upng.h"
 
 typedef struct {
 	float u, v;
 } tex2_t;
 
+// Decoded texture, owns the png it was decoded from (png is NULL for static data)
+typedef struct {
+	upng_t* png;
+	uint32_t* texels;
+	int width;
+	int height;
+} texture_t;
+
 extern int texture_width;
 extern int texture_height;
 
@@ -16,4 +26,16 @@ extern uint32_t* mesh_texture;
 extern const uint8_t REDBRICK_TEXTURE[];
 
 void load_png_texture_data(char* filename);
+bool load_png_texture(texture_t* target, char* filename);
+void set_mesh_texture(texture_t texture);
+texture_t get_mesh_texture(void);
+texture_t get_placeholder_texture(void);
+void free_texture(texture_t* texture);
 tex2_t tex2_clone(tex2_t* t);
+
+// Texel of u,v with wrap around, for the rasterizer inner loops
+static inline int texel_index(texture_t* texture, float u, float v) {
+	int tex_x = abs((int)(u * texture->width)) % texture->width;
+	int tex_y = abs((int)(v * texture->height)) % texture->height;
+	return (texture->width * tex_y) + tex_x;
+}
@@ -0,0 +1,126 @@
+#include <SDL2/SDL.h>
+#include "timing.h"
+
+#define NS_PER_SECOND 1000000000ull
+#define NS_PER_MS 1000000ull
+
+// Sleep only while at least this long remains, spin for the rest: covers the
+// usual sleep overshoot of the OS scheduler
+#define SPIN_MARGIN_NS (2 * NS_PER_MS)
+
+// Longest frame the simulation catches up on, so a stall (window drag,
+// debugger) does not turn into a burst of steps
+#define MAX_FRAME_DELTA_NS (250 * NS_PER_MS)
+
+typedef struct {
+	int pacing;
+	uint64_t frame_ns;		// target frame duration, 0 when not paced
+	uint64_t step_ns;		// fixed simulation step
+	uint64_t deadline_ns;	// when the next frame should start
+	uint64_t previous_ns;	// start of the previous frame
+	uint64_t accumulator_ns;	// simulated time not yet stepped
+	uint64_t delta_ns;		// duration of the last frame
+	uint64_t frame_count;
+} frame_timing_t;
+
+static frame_timing_t timing = {
+	.pacing = PACING_CAPPED,
+	.frame_ns = NS_PER_SECOND / 60,
+	.step_ns = NS_PER_SECOND / 60,
+	.deadline_ns = 0,
+	.previous_ns = 0,
+	.accumulator_ns = 0,
+	.delta_ns = 0,
+	.frame_count = 0
+};
+
+uint64_t get_time_ns(void) {
+	static uint64_t frequency = 0;
+	if (frequency == 0) {
+		frequency = SDL_GetPerformanceFrequency();
+	}
+	uint64_t counter = SDL_GetPerformanceCounter();
+	// Split to keep counter * 1e9 from overflowing
+	return (counter / frequency) * NS_PER_SECOND + (counter % frequency) * NS_PER_SECOND / frequency;
+}
+
+void init_frame_timing(int pacing, int target_fps, int simulation_hz) {
+	timing.pacing = pacing;
+	timing.frame_ns = (pacing == PACING_CAPPED && target_fps > 0) ? NS_PER_SECOND / target_fps : 0;
+	timing.step_ns = NS_PER_SECOND / (simulation_hz > 0 ? simulation_hz : 60);
+	timing.previous_ns = get_time_ns();
+	timing.deadline_ns = timing.previous_ns + timing.frame_ns;
+	timing.accumulator_ns = 0;
+	timing.delta_ns = 0;
+	timing.frame_count = 0;
+}
+
+int get_frame_pacing(void) {
+	return timing.pacing;
+}
+
+// Block until the next frame is due, then account for the time since the last
+static void pace_frame(void) {
+	if (timing.frame_ns == 0) {
+		return;
+	}
+	uint64_t now = get_time_ns();
+	while (now < timing.deadline_ns) {
+		uint64_t remaining = timing.deadline_ns - now;
+		if (remaining > SPIN_MARGIN_NS) {
+			SDL_Delay((Uint32)((remaining - SPIN_MARGIN_NS) / NS_PER_MS));
+		}
+		now = get_time_ns();
+	}
+
+	// Schedule from the previous deadline to keep a steady cadence, unless the
+	// frame ran so late that catching up would mean several frames at once
+	timing.deadline_ns += timing.frame_ns;
+	if (timing.deadline_ns < now) {
+		timing.deadline_ns = now + timing.frame_ns;
+	}
+}
+
+void wait_for_next_frame(void) {
+	pace_frame();
+
+	uint64_t now = get_time_ns();
+	timing.delta_ns = now - timing.previous_ns;
+	timing.previous_ns = now;
+	timing.frame_count++;
+
+	if (timing.pacing == PACING_BENCHMARK) {
+		timing.accumulator_ns += timing.step_ns;
+		return;
+	}
+	timing.accumulator_ns += timing.delta_ns < MAX_FRAME_DELTA_NS ? timing.delta_ns : MAX_FRAME_DELTA_NS;
+}
+
+// True while a whole simulation step is pending, consuming it
+bool step_simulation(void) {
+	if (timing.accumulator_ns < timing.step_ns) {
+		return false;
+	}
+	timing.accumulator_ns -= timing.step_ns;
+	return true;
+}
+
+// How far (0..1) the frame is between the last two simulation steps
+float get_simulation_alpha(void) {
+	return (float)((double)timing.accumulator_ns / (double)timing.step_ns);
+}
+
+// Seconds per simulation step
+float get_simulation_step(void) {
+	return (float)((double)timing.step_ns / NS_PER_SECOND);
+}
+
+// Seconds the last frame took (one step in benchmark mode)
+float get_frame_delta(void) {
+	uint64_t delta = timing.pacing == PACING_BENCHMARK ? timing.step_ns : timing.delta_ns;
+	return (float)((double)delta / NS_PER_SECOND);
+}
+
+uint64_t get_frame_count(void) {
+	return timing.frame_count;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// Frame pacing and fixed timestep simulation
+////////////////////////////////////////////////////////////////////////////////
+// Time is kept in integer nanoseconds of the monotonic performance counter.
+// wait_for_next_frame() paces frames to the target rate: it sleeps while the
+// deadline is far and spins for the last stretch, so it neither oversleeps by
+// a scheduler quantum nor burns a core all frame. The simulation advances in
+// fixed steps drained from an accumulator with step_simulation(), and the
+// renderer blends the last two steps by get_simulation_alpha().
+//
+// In benchmark mode frames are not paced and every frame advances exactly one
+// step, so a run renders the same frames however fast the machine is.
+
+enum frame_pacing {
+	PACING_CAPPED,		// wait for target_fps, simulate in real time
+	PACING_UNCAPPED,	// render as fast as possible, simulate in real time
+	PACING_BENCHMARK	// render as fast as possible, one step per frame
+};
+
+uint64_t get_time_ns(void);
+
+void init_frame_timing(int pacing, int target_fps, int simulation_hz);
+int get_frame_pacing(void);
+void wait_for_next_frame(void);
+bool step_simulation(void);
+float get_simulation_alpha(void);
+float get_simulation_step(void);
+float get_frame_delta(void);
+uint64_t get_frame_count(void);
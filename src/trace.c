@@ -0,0 +1,171 @@
+#include <SDL2/SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace.h"
+#include "timing.h"
+
+typedef struct {
+	const char* name;
+	uint64_t time_ns;
+	char phase;		// 'B' begin, 'E' end
+} trace_event_t;
+
+// Written only by the thread holding it. written counts every event recorded
+// into the ring, event n lives in slot n % TRACE_EVENTS_PER_THREAD.
+typedef struct trace_ring {
+	trace_event_t events[TRACE_EVENTS_PER_THREAD];
+	SDL_atomic_t written;
+	SDL_atomic_t in_use;	// held by a live thread
+	const char* thread_name;
+	int thread_index;
+	struct trace_ring* next;
+} trace_ring_t;
+
+static SDL_atomic_t tracing;
+static uint64_t trace_start_ns = 0;
+static SDL_TLSID ring_key = 0;
+static SDL_TLSID thread_name_key = 0;
+static trace_ring_t* rings = NULL;	// every ring, pushed lock-free
+static SDL_atomic_t num_rings;
+
+// On the main thread, before any other thread starts
+void init_tracing(void) {
+	ring_key = SDL_TLSCreate();
+	thread_name_key = SDL_TLSCreate();
+	trace_start_ns = get_time_ns();
+}
+
+void set_tracing(bool enabled) {
+	SDL_AtomicSet(&tracing, enabled && ring_key != 0);
+}
+
+bool is_tracing_enabled(void) {
+	return SDL_AtomicGet(&tracing);
+}
+
+// Label the calling thread's track in the trace
+void set_trace_thread_name(const char* name) {
+	if (thread_name_key != 0) {
+		SDL_TLSSet(thread_name_key, name, NULL);
+	}
+}
+
+// Hand the calling thread's ring on to the next thread of its name
+void end_trace_thread(void) {
+	if (ring_key == 0) {
+		return;
+	}
+	trace_ring_t* ring = SDL_TLSGet(ring_key);
+	if (ring != NULL) {
+		SDL_TLSSet(ring_key, NULL, NULL);
+		SDL_AtomicSet(&ring->in_use, 0);
+	}
+}
+
+static trace_ring_t* acquire_thread_ring(void) {
+	const char* name = SDL_TLSGet(thread_name_key);
+	if (name != NULL) {
+		for (trace_ring_t* ring = SDL_AtomicGetPtr((void**)&rings); ring != NULL; ring = ring->next) {
+			if (ring->thread_name != NULL && strcmp(ring->thread_name, name) == 0 && SDL_AtomicCAS(&ring->in_use, 0, 1)) {
+				SDL_TLSSet(ring_key, ring, NULL);
+				return ring;
+			}
+		}
+	}
+
+	trace_ring_t* ring = calloc(1, sizeof(trace_ring_t));
+	if (ring == NULL) {
+		return NULL;
+	}
+	ring->thread_name = name;
+	ring->thread_index = SDL_AtomicAdd(&num_rings, 1);
+	SDL_AtomicSet(&ring->in_use, 1);
+	do {
+		ring->next = SDL_AtomicGetPtr((void**)&rings);
+	} while (!SDL_AtomicCASPtr((void**)&rings, ring->next, ring));
+	SDL_TLSSet(ring_key, ring, NULL);
+	return ring;
+}
+
+static void record_event(const char* name, char phase) {
+	trace_ring_t* ring = SDL_TLSGet(ring_key);
+	if (ring == NULL && (ring = acquire_thread_ring()) == NULL) {
+		return;
+	}
+	int index = SDL_AtomicGet(&ring->written);
+	trace_event_t* event = &ring->events[index % TRACE_EVENTS_PER_THREAD];
+	event->name = name;
+	event->time_ns = get_time_ns();
+	event->phase = phase;
+	// Publishes the event to write_trace_file
+	SDL_AtomicSet(&ring->written, index + 1);
+}
+
+void trace_begin(const char* name) {
+	if (SDL_AtomicGet(&tracing)) {
+		record_event(name, 'B');
+	}
+}
+
+void trace_end(const char* name) {
+	if (SDL_AtomicGet(&tracing)) {
+		record_event(name, 'E');
+	}
+}
+
+static void write_ring(FILE* file, trace_ring_t* ring, bool* first) {
+	if (ring->thread_name != NULL) {
+		fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+			*first ? "" : ",\n", ring->thread_index, ring->thread_name);
+		*first = false;
+	}
+
+	int end = SDL_AtomicGet(&ring->written);
+	int start = end > TRACE_EVENTS_PER_THREAD ? end - TRACE_EVENTS_PER_THREAD : 0;
+	for (int i = start; i < end; i++) {
+		trace_event_t event = ring->events[i % TRACE_EVENTS_PER_THREAD];
+
+		// The thread keeps recording while this runs: drop the event if its
+		// slot may have been reused while it was read. The slot of event i is
+		// overwritten by event i + TRACE_EVENTS_PER_THREAD, which is being
+		// written as soon as written reaches that index.
+		if (SDL_AtomicGet(&ring->written) - TRACE_EVENTS_PER_THREAD >= i) {
+			continue;
+		}
+		fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%d}",
+			*first ? "" : ",\n", event.name, event.phase, (event.time_ns - trace_start_ns) / 1000.0, ring->thread_index);
+		*first = false;
+	}
+}
+
+// Dump what every ring holds. Recording can go on meanwhile.
+bool write_trace_file(const char* path) {
+	FILE* file = fopen(path, "w");
+	if (file == NULL) {
+		fprintf(stderr, "Error opening trace file %s.\n", path);
+		return false;
+	}
+	bool first = true;
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	for (trace_ring_t* ring = SDL_AtomicGetPtr((void**)&rings); ring != NULL; ring = ring->next) {
+		write_ring(file, ring, &first);
+	}
+	fprintf(file, "\n]}\n");
+	fclose(file);
+	return true;
+}
+
+// Once every recording thread has finished
+void free_trace_buffers(void) {
+	trace_ring_t* ring = rings;
+	while (ring != NULL) {
+		trace_ring_t* next = ring->next;
+		free(ring);
+		ring = next;
+	}
+	rings = NULL;
+	if (ring_key != 0) {
+		SDL_TLSSet(ring_key, NULL, NULL);
+	}
+}
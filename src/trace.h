@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdbool.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// Frame timeline tracing, exported as Chrome trace-event JSON (Perfetto,
+// chrome://tracing)
+////////////////////////////////////////////////////////////////////////////////
+// Every thread records into its own ring buffer, so recording takes no lock
+// and only the oldest events of a long session are lost. A ring is allocated
+// on a thread's first event; a thread reuses the ring of a finished thread of
+// the same name, so each asset load does not add a track. Names are not
+// copied: pass string literals. Begin/end pairs must nest on each thread.
+// Recording calls cost one flag test while tracing is off.
+
+#define TRACE_EVENTS_PER_THREAD 65536
+
+void init_tracing(void);
+void set_tracing(bool enabled);
+bool is_tracing_enabled(void);
+void set_trace_thread_name(const char* name);
+void end_trace_thread(void);
+
+void trace_begin(const char* name);
+void trace_end(const char* name);
+
+// Time the statement or block that follows. As with PROFILE_SCOPE, break and
+// continue in the block end the scope (the end is still recorded), never a
+// loop around it, and return or goto out of it leave the event open: use
+// trace_begin/trace_end for blocks that need those.
+#define TRACE_SCOPE(name) \
+	for (int trace_once_ = (trace_begin(name), 1); trace_once_; trace_once_ = 0, trace_end(name)) \
+		for (int trace_body_ = 1; trace_body_; trace_body_ = 0)
+
+bool write_trace_file(const char* path);
+void free_trace_buffers(void);
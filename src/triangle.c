@@ -1,7 +1,13 @@
 #include <stdint.h>
+#include <string.h>
 #include "triangle.h"
 #include "display.h"
+#include "framebuffer.h"
 #include "swap.h"
+#include "array.h"
+#include "overdraw.h"
+#include "visibility.h"
+#include "profiler.h"
 
 ///////////////////////////////////////////////////////////////////////////////
 // Draw a filled a triangle with a flat bottom
@@ -68,151 +74,129 @@
 // }
 
 
-void draw_triangle_pixel(
-	int x, int y, 
-	uint32_t color,
-	vec4_t point_a, vec4_t point_b, vec4_t point_c
-) {
-	// float u0, float v0, float u1, float v1, float u2, float v2
-	vec2_t p = { x, y };
-	vec2_t a = vec2_from_vec4(point_a);
-	vec2_t b = vec2_from_vec4(point_b);
-	vec2_t c = vec2_from_vec4(point_c);
-
-	vec3_t weights = barycentric_weights(a, b, c, p);
-
-	float alpha = weights.x;
-	float beta = weights.y;
-	float gamma = weights.z;
-
-	// Variables to store the interpolated values of U, V, 1/w for current pixel
-	float interpolated_reciprocal_w;
+///////////////////////////////////////////////////////////////////////////////
+// Bin triangles by material with a stable counting sort: order[] receives the
+// triangle indices grouped by material, original order kept within a material,
+// so render() switches textures once per material instead of per triangle.
+// There is a bin for every material slot of the scene, however many.
+///////////////////////////////////////////////////////////////////////////////
+static int* material_bins = NULL;	// num_materials + 1 run starts, reused
+
+// Stable counting pass: the triangles listed in source[] (mesh order when
+// NULL) into destination[], grouped by material
+static void bin_by_material(const triangle_t triangles[], const int source[], int destination[], int count, int num_materials) {
+	if (num_materials < 1) num_materials = 1;
+	material_bins = array_reserve(material_bins, num_materials + 1, sizeof(int));
+	memset(material_bins, 0, sizeof(int) * (num_materials + 1));
+
+	for (int i = 0; i < count; i++) {
+		int material = triangles[i].material;
+		if (material < 0 || material >= num_materials) material = 0;
+		material_bins[material + 1]++;
+	}
+	for (int m = 0; m < num_materials; m++) {
+		material_bins[m + 1] += material_bins[m];
+	}
+	for (int i = 0; i < count; i++) {
+		int triangle = source != NULL ? source[i] : i;
+		int material = triangles[triangle].material;
+		if (material < 0 || material >= num_materials) material = 0;
+		destination[material_bins[material]++] = triangle;
+	}
+}
 
-	// Also interpolate the value of 1/w for the current pixel
-	interpolated_reciprocal_w = (1 / point_a.w) * alpha + (1 / point_b.w) * beta + (1 / point_c.w) * gamma;
+void sort_triangles_by_material(triangle_t triangles[], int num_triangles, int num_materials, int order[]) {
+	bin_by_material(triangles, NULL, order, num_triangles, num_materials);
+}
 
-	// Adjust 1/w so pixels that are closer to the camera have smaller values, futher have larger
-	interpolated_reciprocal_w = 1.0 - interpolated_reciprocal_w;
+///////////////////////////////////////////////////////////////////////////////
+// Front to back within each material bin, so most hidden pixels fail the depth
+// test before they are shaded. LSD radix sort on a 16-bit depth key, 1/w at
+// the triangle's centroid quantized against the nearest triangle of the frame
+// and inverted so near sorts first, in two 8-bit passes; then the stable
+// material counting pass above keeps the bins. All passes are stable, so equal
+// keys keep mesh order and the result is deterministic.
+///////////////////////////////////////////////////////////////////////////////
+static int draw_order = DRAW_ORDER_MATERIAL;
+static uint16_t* depth_keys = NULL;
+static float* centroid_inv_w = NULL;
+static int* sort_scratch = NULL;
 
-	// Only draw the pixel if the depth value is less than the one previously stored in the z-buffer
-	if (get_zbuffer_at(x, y) > interpolated_reciprocal_w) {
-		// Draw a pixel at position (x,y) with the color that comes from the mapped texture
-		draw_pixel(x, y, color);
+void set_draw_order(int order) {
+	draw_order = order;
+}
 
-		// Upate the z-buffer value with 1/w this pixel
-		update_zbuffer_at(x, y, interpolated_reciprocal_w);
-	}
+int get_draw_order(void) {
+	return draw_order;
 }
 
-void draw_filled_triangle(int x0, int y0, float w0, int x1, int y1, float w1, int x2, int y2, float w2, uint32_t color) {
-	// order coords by y-coord top->bottom 0->2 :: y0 < y1 < y2
-	if (y0 > y1) {
-		swap_int(&y0, &y1);
-		swap_int(&x0, &x1);
-		swap_float(&w0, &w1);
+// One stable counting pass over the byte of the keys at shift
+static void radix_pass(const uint16_t keys[], const int source[], int destination[], int count, int shift) {
+	int offsets[257] = { 0 };
+	for (int i = 0; i < count; i++) {
+		offsets[((keys[source[i]] >> shift) & 0xFF) + 1]++;
 	}
-	if (y1 > y2) {
-		swap_int(&y1, &y2);
-		swap_int(&x1, &x2);
-		swap_float(&w1, &w2);
+	for (int b = 0; b < 256; b++) {
+		offsets[b + 1] += offsets[b];
 	}
-	if (y0 > y1) {
-		swap_int(&y0, &y1);
-		swap_int(&x0, &x1);
-		swap_float(&w0, &w1);
+	for (int i = 0; i < count; i++) {
+		destination[offsets[(keys[source[i]] >> shift) & 0xFF]++] = source[i];
 	}
+}
 
-	// Create vector points and texture coords after vertices sorted
-	vec4_t point_a = { x0, y0, 0, w0 };
-	vec4_t point_b = { x1, y1, 0, w1 };
-	vec4_t point_c = { x2, y2, 0, w2 };
-
-	///////////////////////////////////////////////////////////////////////////////
-	// Render upper half of triangle (flat-bottom)
-	///////////////////////////////////////////////////////////////////////////////
-	float inv_slope_1;
-	float inv_slope_2;
-	if (y1 - y0 != 0) inv_slope_1 = (float)(x1 - x0) / abs(y1 - y0);
-	if (y2 - y0 != 0) inv_slope_2 = (float)(x2 - x0) / abs(y2 - y0);
-	if (y1 - y0 != 0) {
-		for (int y = y0; y <= y1; y++) {
-			int x_start = x1 + (y - y1) * inv_slope_1;
-			int x_end = x0 + (y - y0) * inv_slope_2;
-
-			if (x_end < x_start) swap_int(&x_end, &x_start);
-
-			for (int x = x_start; x <= x_end; x++) { // x <= x_end or <, mine differs from lecture "viz textured triangles"
-				draw_triangle_pixel(
-					x, y, 
-					color,
-					point_a, point_b, point_c
-				);
-			}
-		}
+void sort_triangles_front_to_back(triangle_t triangles[], int num_triangles, int num_materials, int order[]) {
+	if (num_triangles <= 0) {
+		return;
 	}
-	///////////////////////////////////////////////////////////////////////////////
-	// Render lower half of triangle (flat-top)
-	///////////////////////////////////////////////////////////////////////////////
-	if (y2 - y1 != 0) inv_slope_1 = (float)(x2 - x1) / abs(y2 - y1);
-	if (y2 - y0 != 0) inv_slope_2 = (float)(x2 - x0) / abs(y2 - y0);
-	if (y2 - y1 != 0) {
-		for (int y = y1; y <= y2; y++) {
-			int x_start = x1 + (y - y1) * inv_slope_1;
-			int x_end = x0 + (y - y0) * inv_slope_2;
-
-			if (x_end < x_start) swap_int(&x_end, &x_start);
-
-			for (int x = x_start; x <= x_end; x++) {
-				draw_triangle_pixel(
-					x, y, 
-					color,
-					point_a, point_b, point_c
-				);
-			}
-		}
+	depth_keys = array_reserve(depth_keys, num_triangles, sizeof(uint16_t));
+	centroid_inv_w = array_reserve(centroid_inv_w, num_triangles, sizeof(float));
+	sort_scratch = array_reserve(sort_scratch, num_triangles, sizeof(int));
+
+	float max_inv_w = 0;
+	for (int i = 0; i < num_triangles; i++) {
+		vec4_t* points = triangles[i].points;
+		float inv_w = (1.0 / points[0].w + 1.0 / points[1].w + 1.0 / points[2].w) * (1.0 / 3.0);
+		centroid_inv_w[i] = inv_w;
+		if (inv_w > max_inv_w) max_inv_w = inv_w;
+	}
+	float scale = max_inv_w > 0 ? 65535.0 / max_inv_w : 0;
+	for (int i = 0; i < num_triangles; i++) {
+		int quantized = (int)(centroid_inv_w[i] * scale);
+		if (quantized < 0) quantized = 0;
+		if (quantized > 0xFFFF) quantized = 0xFFFF;
+		depth_keys[i] = 0xFFFF - quantized;
+		order[i] = i;
 	}
 
+	radix_pass(depth_keys, order, sort_scratch, num_triangles, 0);
+	radix_pass(depth_keys, sort_scratch, order, num_triangles, 8);
 
-	// BELOW REPLACED TO USE Z-BUFFER
-	// // y0 > y1 > y2
-	// if (y0 > y1) {
-	// 	swap_int(&y0, &y1);
-	// 	swap_int(&x0, &x1);
-	// }
-	// if (y1 > y2) {
-	// 	swap_int(&y1, &y2);
-	// 	swap_int(&x1, &x2);
-	// }
-	// if (y0 > y1) {
-	// 	swap_int(&y0, &y1);
-	// 	swap_int(&x0, &x1);
-	// }
-	//
-	// // if ((y2 - y0) == 0) return;	// ? does culling take care of this?
-	//
-	// if (y1 == y2) {
-	// 	fill_flat_bottom_triangle(x0, y0, x1, y1, x2, y2, color);
-	// } else if (y0 == y1) {
-	// 	fill_flat_top_triangle(x0, y0, x1, y1, x2, y2, color);
-	// } else {
-	// 	// Calculate new vertex (Mx, My) using similar triangles
-	// 	// int xm = (((float)(y1 - y0) * (x2 - x0)) / (float)(y2 - y0)) + x0;
-	// 	int xm = (((y1 - y0) * (x2 - x0)) / (y2 - y0)) + x0;
-	// 	int ym = y1;
-	//
-	// 	fill_flat_bottom_triangle(x0, y0, x1, y1, xm, ym, color);
-	// 	fill_flat_top_triangle(x1, y1, xm, ym, x2, y2, color);
-	// }
+	if (num_materials <= 1) {
+		return;
+	}
+	// Stable material pass over the depth order
+	bin_by_material(triangles, order, sort_scratch, num_triangles, num_materials);
+	memcpy(order, sort_scratch, sizeof(int) * num_triangles);
 }
 
-void texture_flat_bottom_triangle(
-	int x0, int y0, float u0, float v0, 
-	int x1, int y1, float u1, float v1,
-	int x2, int y2, float u2, float v2, 
-	uint32_t* texture
-) {
-	// for every pixel on the face, draw a texel
+// Draw order of the current draw order setting
+void sort_triangles(triangle_t triangles[], int num_triangles, int num_materials, int order[]) {
+	if (draw_order == DRAW_ORDER_FRONT_TO_BACK) {
+		sort_triangles_front_to_back(triangles, num_triangles, num_materials, order);
+	} else {
+		sort_triangles_by_material(triangles, num_triangles, num_materials, order);
+	}
+}
 
+void free_triangle_sort_buffers(void) {
+	array_free(depth_keys);
+	array_free(centroid_inv_w);
+	array_free(sort_scratch);
+	array_free(material_bins);
+	depth_keys = NULL;
+	centroid_inv_w = NULL;
+	sort_scratch = NULL;
+	material_bins = NULL;
 }
 
 vec3_t barycentric_weights(vec2_t a, vec2_t b, vec2_t c, vec2_t p) {
@@ -236,174 +220,257 @@ vec3_t barycentric_weights(vec2_t a, vec2_t b, vec2_t c, vec2_t p) {
 	return weights;
 }
 
-// Draw textured pixel at position x and y using interpolation
+///////////////////////////////////////////////////////////////////////////////
+// Perspective-correct texture interpolation
+///////////////////////////////////////////////////////////////////////////////
+// u/w, v/w and 1/w are linear in screen space, so their x and y gradients are
+// set up once per triangle and stepped by one add per pixel. Undoing the 1/w
+// costs a reciprocal; with a subdivision of N the span is cut into N pixel
+// pieces that get the exact u,v at their ends and are stepped affinely in
+// between, one reciprocal per N pixels. 1 is exact per pixel.
+///////////////////////////////////////////////////////////////////////////////
+static int texture_subdivision = TEXTURE_SUBDIVISION_EXACT;
 
-void draw_texel(
-	int x, int y, 
-	uint32_t* texture,
-	vec4_t point_a, vec4_t point_b, vec4_t point_c, 
-	tex2_t a_uv, tex2_t b_uv, tex2_t c_uv
+void set_texture_subdivision(int pixels) {
+	texture_subdivision = pixels < 1 ? 1 : pixels;
+}
+
+int get_texture_subdivision(void) {
+	return texture_subdivision;
+}
+
+// Per-triangle state shared by all rasterizer kernels
+typedef struct {
+	int x[3], y[3];				// vertices sorted top to bottom
+	int y_min, y_max;			// rows inside the scissor
+	float x0, y0;				// screen position where the plane values hold
+	attribute_plane_t w;		// 1/w
+	attribute_plane_t u, v;		// u/w and v/w
+	attribute_plane_t shade;	// Gouraud light intensity
+	uint32_t color;
+	texture_t* texture;
+	uint32_t* overdraw;			// counters of the overdraw view, see overdraw.h
+	int overdraw_pitch;
+	uint32_t* visibility;		// triangle ids of the visibility buffer, see visibility.h
+	int visibility_pitch;
+	uint32_t visibility_id;
+	framebuffer_t framebuffer;
+} triangle_setup_t;
+
+// Pixel counters of one triangle, handed to the profiler once it is done
+typedef struct {
+	int tested;
+	int written;
+} pixel_counts_t;
+
+// Macros rather than an enum: triangle_kernel.h tests them with #if
+#define SHADE_NONE 0
+#define SHADE_FLAT 1
+#define SHADE_GOURAUD 2
+#define SHADE_TEXTURED 3
+#define SHADE_OVERDRAW 4
+#define SHADE_VISIBILITY 5
+#define NUM_SHADINGS 6
+
+// Solve the screen-space plane of a0,a1,a2 over the triangle
+static inline attribute_plane_t plane_from_vertices(
+	float dx1, float dy1, float dx2, float dy2, float inv_area,
+	float a0, float a1, float a2
 ) {
-	// float u0, float v0, float u1, float v1, float u2, float v2
-	vec2_t p = { x, y };
-	vec2_t a = vec2_from_vec4(point_a);
-	vec2_t b = vec2_from_vec4(point_b);
-	vec2_t c = vec2_from_vec4(point_c);
+	attribute_plane_t plane = {
+		.value = a0,
+		.dx = ((a1 - a0) * dy2 - (a2 - a0) * dy1) * inv_area,
+		.dy = ((a2 - a0) * dx1 - (a1 - a0) * dx2) * inv_area
+	};
+	return plane;
+}
+
+static inline float clamp_shade(float shade) {
+	return shade < 0 ? 0 : (shade > 1 ? 1 : shade);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Sort the vertices by y and set up the attribute planes the shading needs.
+// Returns false for triangles that cover no pixel centers. Inlined into every
+// kernel with a constant shading, so unused planes are never computed.
+///////////////////////////////////////////////////////////////////////////////
+static inline bool setup_triangle(triangle_t* triangle, texture_t* texture, int shading, triangle_setup_t* setup) {
+	int x[3], y[3];
+	for (int j = 0; j < 3; j++) {
+		x[j] = triangle->points[j].x;
+		y[j] = triangle->points[j].y;
+	}
 
-	vec3_t weights = barycentric_weights(a, b, c, p);
+	// order vertex indices by y-coord top->bottom 0->2 :: y0 < y1 < y2
+	int order[3] = { 0, 1, 2 };
+	if (y[order[0]] > y[order[1]]) swap_int(&order[0], &order[1]);
+	if (y[order[1]] > y[order[2]]) swap_int(&order[1], &order[2]);
+	if (y[order[0]] > y[order[1]]) swap_int(&order[0], &order[1]);
+
+	float w[3], u[3], v[3], shade[3];
+	for (int j = 0; j < 3; j++) {
+		int i = order[j];
+		setup->x[j] = x[i];
+		setup->y[j] = y[i];
+		w[j] = 1.0 / triangle->points[i].w;
+		if (shading == SHADE_TEXTURED || shading == SHADE_VISIBILITY) {
+			// Flip the V component to account for inverted UV-coordinates
+			u[j] = triangle->texcoords[i].u * w[j];
+			v[j] = (1.0 - triangle->texcoords[i].v) * w[j];
+		}
+		if (shading == SHADE_GOURAUD) {
+			shade[j] = clamp_shade(triangle->shades[i]);
+		}
+	}
+
+	float dx1 = setup->x[1] - setup->x[0], dy1 = setup->y[1] - setup->y[0];
+	float dx2 = setup->x[2] - setup->x[0], dy2 = setup->y[2] - setup->y[0];
+	float area = dx1 * dy2 - dx2 * dy1;
+	if (area == 0) {
+		return false;
+	}
+	float inv_area = 1.0 / area;
+
+	// Scissor once here, so the spans can write without bounds checks
+	setup->framebuffer = get_framebuffer();
+	scissor_t scissor = setup->framebuffer.scissor;
+	int min_x = setup->x[0], max_x = setup->x[0];
+	for (int j = 1; j < 3; j++) {
+		if (setup->x[j] < min_x) min_x = setup->x[j];
+		if (setup->x[j] > max_x) max_x = setup->x[j];
+	}
+	if (max_x < scissor.x0 || min_x > scissor.x1 || setup->y[2] < scissor.y0 || setup->y[0] > scissor.y1) {
+		return false;
+	}
+	setup->y_min = setup->y[0] > scissor.y0 ? setup->y[0] : scissor.y0;
+	setup->y_max = setup->y[2] < scissor.y1 ? setup->y[2] : scissor.y1;
+
+	// Bounds padded by a pixel for the rounding of the edge walk
+	prepare_framebuffer_rect(min_x - 1, setup->y_min - 1, max_x + 1, setup->y_max + 1);
+
+	setup->x0 = setup->x[0];
+	setup->y0 = setup->y[0];
+	setup->w = plane_from_vertices(dx1, dy1, dx2, dy2, inv_area, w[0], w[1], w[2]);
+	if (shading == SHADE_TEXTURED || shading == SHADE_VISIBILITY) {
+		setup->u = plane_from_vertices(dx1, dy1, dx2, dy2, inv_area, u[0], u[1], u[2]);
+		setup->v = plane_from_vertices(dx1, dy1, dx2, dy2, inv_area, v[0], v[1], v[2]);
+		setup->texture = texture;
+	}
+	if (shading == SHADE_VISIBILITY) {
+		setup->visibility = get_visibility_buffer();
+		setup->visibility_pitch = get_visibility_pitch();
+		if (setup->visibility == NULL) {
+			return false;
+		}
+		// The resolve textures the pixels from these planes, padded bounds as above
+		visibility_triangle_t planes = { setup->x0, setup->y0, setup->w, setup->u, setup->v, texture, {
+			min_x - 1 > scissor.x0 ? min_x - 1 : scissor.x0, setup->y_min,
+			max_x + 1 < scissor.x1 ? max_x + 1 : scissor.x1, setup->y_max
+		} };
+		setup->visibility_id = add_visibility_triangle(&planes);
+	}
+	if (shading == SHADE_OVERDRAW) {
+		setup->overdraw = get_overdraw_buffer();
+		setup->overdraw_pitch = get_overdraw_pitch();
+		if (setup->overdraw == NULL) {
+			return false;
+		}
+	}
+	if (shading == SHADE_GOURAUD) {
+		setup->shade = plane_from_vertices(dx1, dy1, dx2, dy2, inv_area, shade[0], shade[1], shade[2]);
+		setup->color = triangle->base_color;
+	} else {
+		setup->color = triangle->color;
+	}
+	return true;
+}
 
-	float alpha = weights.x;
-	float beta = weights.y;
-	float gamma = weights.z;
+// Reversed unorm depth: z_near/w scaled to the format's range (scale holds
+// both), clamped for the rounding at the near plane
+static inline uint32_t depth_to_unorm(float w, float scale, uint32_t max) {
+	float depth = w * scale;
+	return depth < (float)max ? (uint32_t)depth : max;
+}
 
-	// Variables to store the interpolated values of U, V, 1/w for current pixel
-	float interpolated_u;
-	float interpolated_v;
-	float interpolated_reciprocal_w;
+// Scale the rgb channels of color by shade (0..1) in 8.8 fixed point
+static inline uint32_t shade_color(uint32_t color, float shade) {
+	uint32_t scale = (uint32_t)(shade * 256);
+	uint32_t r = (((color >> 16) & 0xFF) * scale) >> 8;
+	uint32_t g = (((color >> 8) & 0xFF) * scale) >> 8;
+	uint32_t b = ((color & 0xFF) * scale) >> 8;
+	if (r > 0xFF) r = 0xFF;
+	if (g > 0xFF) g = 0xFF;
+	if (b > 0xFF) b = 0xFF;
+	return (color & 0xFF000000) | (r << 16) | (g << 8) | b;
+}
 
-	// Perform interpolate of all U/w and V/w values using barycentric weights
-	// and a factor of 1/w
-	interpolated_u = ((a_uv.u / point_a.w) * alpha) + ((b_uv.u / point_b.w) * beta) + ((c_uv.u / point_c.w) * gamma);
-	interpolated_v = ((a_uv.v / point_a.w) * alpha) + ((b_uv.v / point_b.w) * beta) + ((c_uv.v / point_c.w) * gamma);
+///////////////////////////////////////////////////////////////////////////////
+// Generate one kernel per render state: depth test x depth write x depth
+// format x shading. See triangle_kernel.h for the template. Wireframe edges
+// are not part of the kernels: render() draws them after every fill.
+///////////////////////////////////////////////////////////////////////////////
+#define KERNEL_PASTE_(a, b) a##b
+#define KERNEL_PASTE(a, b) KERNEL_PASTE_(a, b)
 
-	// Also interpolate the value of 1/w for the current pixel
-	interpolated_reciprocal_w = (1 / point_a.w) * alpha + (1 / point_b.w) * beta + (1 / point_c.w) * gamma;
+#define KERNEL_PREFIX kernel_flat
+#define KERNEL_SHADING SHADE_FLAT
+#include "triangle_kernel.h"
 
-	// Now we can divide back both interpolated values by 1/w
-	interpolated_u /= interpolated_reciprocal_w;
-	interpolated_v /= interpolated_reciprocal_w;
+#define KERNEL_PREFIX kernel_gouraud
+#define KERNEL_SHADING SHADE_GOURAUD
+#include "triangle_kernel.h"
 
-	// Map the UV coord to full texture width and height
-	int tex_x = abs((int)(interpolated_u * texture_width)) % texture_width;
-	int tex_y = abs((int)(interpolated_v * texture_height)) % texture_height;
+#define KERNEL_PREFIX kernel_textured
+#define KERNEL_SHADING SHADE_TEXTURED
+#include "triangle_kernel.h"
 
-	// Adjust 1/w so pixels that are closer to the camera have smaller values, futher have larger
-	interpolated_reciprocal_w = 1.0 - interpolated_reciprocal_w;
+#define KERNEL_PREFIX kernel_overdraw
+#define KERNEL_SHADING SHADE_OVERDRAW
+#include "triangle_kernel.h"
 
-	// Only draw the pixel if the depth value is less than the one previously stored in the z-buffer
-	if (get_zbuffer_at(x, y) > interpolated_reciprocal_w) {
-		// Draw a pixel at position (x,y) with the color that comes from the mapped texture
-		draw_pixel(x, y, texture[(texture_width * tex_y) + tex_x]);
+#define KERNEL_PREFIX kernel_visibility
+#define KERNEL_SHADING SHADE_VISIBILITY
+#include "triangle_kernel.h"
 
-		// Upate the z-buffer value with 1/w this pixel
-		update_zbuffer_at(x, y, interpolated_reciprocal_w);
-	}
+#define KERNEL_DEPTH_VARIANTS(prefix) { \
+	{ prefix##_t0_w0, prefix##_t0_w1 }, \
+	{ prefix##_t1_w0, prefix##_t1_w1 } \
 }
+#define KERNEL_FORMAT_VARIANTS(prefix) { \
+	[DEPTH_FLOAT] = KERNEL_DEPTH_VARIANTS(prefix##_float), \
+	[DEPTH_FLOAT_REVERSED] = KERNEL_DEPTH_VARIANTS(prefix##_reversed), \
+	[DEPTH_UNORM24] = KERNEL_DEPTH_VARIANTS(prefix##_unorm24), \
+	[DEPTH_UNORM16] = KERNEL_DEPTH_VARIANTS(prefix##_unorm16) \
+}
+
+// Indexed [shading][depth format][depth test][depth write], none for SHADE_NONE
+static const triangle_kernel_t triangle_kernels[NUM_SHADINGS][NUM_DEPTH_FORMATS][2][2] = {
+	[SHADE_FLAT] = KERNEL_FORMAT_VARIANTS(kernel_flat),
+	[SHADE_GOURAUD] = KERNEL_FORMAT_VARIANTS(kernel_gouraud),
+	[SHADE_TEXTURED] = KERNEL_FORMAT_VARIANTS(kernel_textured),
+	[SHADE_OVERDRAW] = KERNEL_FORMAT_VARIANTS(kernel_overdraw),
+	[SHADE_VISIBILITY] = KERNEL_FORMAT_VARIANTS(kernel_visibility),
+};
 
 ///////////////////////////////////////////////////////////////////////////////
-// Draw a filled triangle with the flat-top/flat-bottom method
-// We split the original triangle in two, half flat-bottom and half flat-top
+// Pick the kernel for the current render method and depth state. Called once
+// per frame; returns NULL when no triangle is filled (wire only methods).
 ///////////////////////////////////////////////////////////////////////////////
-//
-//          (x0,y0)
-//            / \
-//           /   \
-//          /     \
-//         /       \
-//        /         \
-//   (x1,y1)------(Mx,My)
-//       \_           \
-//          \_         \
-//             \_       \
-//                \_     \
-//                   \    \
-//                     \_  \
-//                        \_\
-//                           \
-//                         (x2,y2)
-//
-///////////////////////////////////////////////////////////////////////////////
-void draw_textured_triangle(
-	int x0, int y0, float z0, float w0, float u0, float v0, 
-	int x1, int y1, float z1, float w1, float u1, float v1,
-	int x2, int y2, float z2, float w2, float u2, float v2, 
-	uint32_t* texture
-) {
-	// order coords by y-coord top->bottom 0->2 :: y0 < y1 < y2
-	if (y0 > y1) {
-		swap_int(&y0, &y1);
-		swap_int(&x0, &x1);
-		swap_float(&z0, &z1);
-		swap_float(&w0, &w1);
-		swap_float(&u0, &u1);
-		swap_float(&v0, &v1);
-	}
-	if (y1 > y2) {
-		swap_int(&y1, &y2);
-		swap_int(&x1, &x2);
-		swap_float(&z1, &z2);
-		swap_float(&w1, &w2);
-		swap_float(&u1, &u2);
-		swap_float(&v1, &v2);
-	}
-	if (y0 > y1) {
-		swap_int(&y0, &y1);
-		swap_int(&x0, &x1);
-		swap_float(&z0, &z1);
-		swap_float(&w0, &w1);
-		swap_float(&u0, &u1);
-		swap_float(&v0, &v1);
+triangle_kernel_t select_triangle_kernel(void) {
+	int shading = SHADE_NONE;
+	if (should_render_overdraw()) {
+		shading = SHADE_OVERDRAW;
+	} else if (should_render_visibility_buffer()) {
+		shading = SHADE_VISIBILITY;
+	} else if (should_render_textured_triangles()) {
+		shading = SHADE_TEXTURED;
+	} else if (should_render_gouraud_triangles()) {
+		shading = SHADE_GOURAUD;
+	} else if (should_render_filled_triangles()) {
+		shading = SHADE_FLAT;
 	}
-
-	// Flip the V component to account for inverted UV-coordinates
-	v0 = 1.0 - v0;
-	v1 = 1.0 - v1;
-	v2 = 1.0 - v2;
-
-	// Create vector points and texture coords after vertices sorted
-	vec4_t point_a = { x0, y0, z0, w0 };
-	vec4_t point_b = { x1, y1, z1, w1 };
-	vec4_t point_c = { x2, y2, z2, w2 };
-	tex2_t a_uv = { u0, v0 };
-	tex2_t b_uv = { u1, v1 };
-	tex2_t c_uv = { u2, v2 };
-
-	///////////////////////////////////////////////////////////////////////////////
-	// Render upper half of triangle (flat-bottom)
-	///////////////////////////////////////////////////////////////////////////////
-	float inv_slope_1;
-	float inv_slope_2;
-	if (y1 - y0 != 0) inv_slope_1 = (float)(x1 - x0) / abs(y1 - y0);
-	if (y2 - y0 != 0) inv_slope_2 = (float)(x2 - x0) / abs(y2 - y0);
-	if (y1 - y0 != 0) {
-		for (int y = y0; y <= y1; y++) {
-			int x_start = x1 + (y - y1) * inv_slope_1;
-			int x_end = x0 + (y - y0) * inv_slope_2;
-
-			if (x_end < x_start) swap_int(&x_end, &x_start);
-
-			for (int x = x_start; x <= x_end; x++) { // x <= x_end or <, mine differs from lecture "viz textured triangles"
-				// draw_pixel(x, y, (x % 4 == 0 && y % 4 == 0) ? BLUE : PURPLE);
-				draw_texel(
-					x, y, 
-					texture,
-					point_a, point_b, point_c, 
-					a_uv, b_uv, c_uv
-				);
-			}
-		}
-	}
-	///////////////////////////////////////////////////////////////////////////////
-	// Render lower half of triangle (flat-top)
-	///////////////////////////////////////////////////////////////////////////////
-	if (y2 - y1 != 0) inv_slope_1 = (float)(x2 - x1) / abs(y2 - y1);
-	if (y2 - y0 != 0) inv_slope_2 = (float)(x2 - x0) / abs(y2 - y0);
-	if (y2 - y1 != 0) {
-		for (int y = y1; y <= y2; y++) {
-			int x_start = x1 + (y - y1) * inv_slope_1;
-			int x_end = x0 + (y - y0) * inv_slope_2;
-
-			if (x_end < x_start) swap_int(&x_end, &x_start);
-
-			for (int x = x_start; x <= x_end; x++) {
-				// draw_pixel(x, y, (x % 4 == 0 && y % 4 == 0) ? BLUE : PURPLE);
-				draw_texel(
-					x, y, 
-					texture,
-					point_a, point_b, point_c, 
-					a_uv, b_uv, c_uv
-				);
-			}
-		}
+	if (shading == SHADE_NONE) {
+		return NULL;
 	}
+	return triangle_kernels[shading][get_depth_format()][is_depth_test_enabled()][is_depth_write_enabled()];
 }
@@ -13,30 +13,45 @@ typedef struct {
 	tex2_t b_uv;
 	tex2_t c_uv;
 	uint32_t color;
+	int material;  // index into the mesh materials, 0 is the default
 } face_t;
 
 typedef struct {
 	vec4_t points[3];
 	tex2_t texcoords[3];
-	uint32_t color;
+	float shades[3];		// per-vertex light intensity, for Gouraud shading
+	uint32_t color;			// flat shaded color
+	uint32_t base_color;	// unlit face color, shaded per pixel by Gouraud
+	int material;
 } triangle_t;
 
-void draw_filled_triangle(int x0, int y0, float w0, int x1, int y1, float w1, int x2, int y2, float w2, uint32_t color);
-// void fill_flat_bottom_triangle(int x0, int y0, int x1, int y1, int xm, int ym, uint32_t color);
-// void fill_flat_top_triangle(int x0, int y0, int x1, int y1, int xm, int ym, uint32_t color);
+// Screen-space plane of an attribute: value at the setup origin and its steps
+typedef struct {
+	float value;
+	float dx;
+	float dy;
+} attribute_plane_t;
 
-void draw_textured_triangle(
-	int x0, int y0, float z0, float w0, float u0, float v0, 
-	int x1, int y1, float z1, float w1, float u1, float v1,
-	int x2, int y2, float z2, float w2, float u2, float v2, 
-	uint32_t* texture
-);
+// A rasterizer specialized for one render state, see select_triangle_kernel()
+typedef void (*triangle_kernel_t)(triangle_t* triangle, texture_t* texture);
+triangle_kernel_t select_triangle_kernel(void);
 
-void draw_texel(
-	int x, int y, 
-	uint32_t* texture,
-	vec4_t point_a, vec4_t point_b, vec4_t point_c, 
-	tex2_t a_uv, tex2_t b_uv, tex2_t c_uv
-);
+// Pixels per exact perspective divide in textured spans (1 = every pixel)
+#define TEXTURE_SUBDIVISION_EXACT 1
+void set_texture_subdivision(int pixels);
+int get_texture_subdivision(void);
 
 vec3_t barycentric_weights(vec2_t a, vec2_t b, vec2_t c, vec2_t p);
+
+// Order render() draws triangles_to_render in
+enum draw_order {
+	DRAW_ORDER_MATERIAL,		// binned by material, mesh order within a bin
+	DRAW_ORDER_FRONT_TO_BACK	// binned by material, nearest first within a bin
+};
+void set_draw_order(int order);
+int get_draw_order(void);
+
+void sort_triangles(triangle_t triangles[], int num_triangles, int num_materials, int order[]);
+void sort_triangles_by_material(triangle_t triangles[], int num_triangles, int num_materials, int order[]);
+void sort_triangles_front_to_back(triangle_t triangles[], int num_triangles, int num_materials, int order[]);
+void free_triangle_sort_buffers(void);
@@ -0,0 +1,272 @@
+///////////////////////////////////////////////////////////////////////////////
+// Triangle rasterizer kernel template
+///////////////////////////////////////////////////////////////////////////////
+// triangle.c includes this file once per shading with
+//   KERNEL_PREFIX    name prefix of the generated kernels
+//   KERNEL_SHADING   SHADE_FLAT, SHADE_GOURAUD, SHADE_TEXTURED or
+//                    SHADE_OVERDRAW (count fragments instead of storing color)
+//                    or SHADE_VISIBILITY (store triangle ids, see visibility.h)
+// defined. The file then includes itself once per depth buffer format, and
+// each of those four more times to stamp out the depth state variants
+// PREFIX_<format>_t{0,1}_w{0,1} (depth test off/on, depth write off/on).
+// All of these are compile-time constants, so every branch on them below folds
+// away and a kernel's span loop only contains the work its state needs.
+// No include guard on purpose.
+///////////////////////////////////////////////////////////////////////////////
+
+#if !defined(KERNEL_DEPTH_FORMAT)
+
+#define KERNEL_DEPTH_FORMAT DEPTH_FLOAT
+#define KERNEL_FORMAT_PREFIX KERNEL_PASTE(KERNEL_PREFIX, _float)
+#include "triangle_kernel.h"
+#define KERNEL_DEPTH_FORMAT DEPTH_FLOAT_REVERSED
+#define KERNEL_FORMAT_PREFIX KERNEL_PASTE(KERNEL_PREFIX, _reversed)
+#include "triangle_kernel.h"
+#define KERNEL_DEPTH_FORMAT DEPTH_UNORM24
+#define KERNEL_FORMAT_PREFIX KERNEL_PASTE(KERNEL_PREFIX, _unorm24)
+#include "triangle_kernel.h"
+#define KERNEL_DEPTH_FORMAT DEPTH_UNORM16
+#define KERNEL_FORMAT_PREFIX KERNEL_PASTE(KERNEL_PREFIX, _unorm16)
+#include "triangle_kernel.h"
+
+#undef KERNEL_PREFIX
+#undef KERNEL_SHADING
+
+#elif !defined(KERNEL_DEPTH_TEST)
+
+#define KERNEL_DEPTH_TEST 0
+#define KERNEL_DEPTH_WRITE 0
+#define KERNEL_NAME KERNEL_PASTE(KERNEL_FORMAT_PREFIX, _t0_w0)
+#include "triangle_kernel.h"
+#define KERNEL_DEPTH_TEST 0
+#define KERNEL_DEPTH_WRITE 1
+#define KERNEL_NAME KERNEL_PASTE(KERNEL_FORMAT_PREFIX, _t0_w1)
+#include "triangle_kernel.h"
+#define KERNEL_DEPTH_TEST 1
+#define KERNEL_DEPTH_WRITE 0
+#define KERNEL_NAME KERNEL_PASTE(KERNEL_FORMAT_PREFIX, _t1_w0)
+#include "triangle_kernel.h"
+#define KERNEL_DEPTH_TEST 1
+#define KERNEL_DEPTH_WRITE 1
+#define KERNEL_NAME KERNEL_PASTE(KERNEL_FORMAT_PREFIX, _t1_w1)
+#include "triangle_kernel.h"
+
+#undef KERNEL_DEPTH_FORMAT
+#undef KERNEL_FORMAT_PREFIX
+
+#else
+
+// Stored depth type, the value stored for an interpolated 1/w, and whether a
+// new value is closer than the stored one
+#if KERNEL_DEPTH_FORMAT == DEPTH_FLOAT
+#define KERNEL_DEPTH_TYPE float
+#define KERNEL_DEPTH_VALUE(w) (1.0f - (w))
+#define KERNEL_DEPTH_CLOSER(value, stored) ((value) < (stored))
+#elif KERNEL_DEPTH_FORMAT == DEPTH_FLOAT_REVERSED
+#define KERNEL_DEPTH_TYPE float
+#define KERNEL_DEPTH_VALUE(w) (w)
+#define KERNEL_DEPTH_CLOSER(value, stored) ((value) > (stored))
+#elif KERNEL_DEPTH_FORMAT == DEPTH_UNORM24
+#define KERNEL_DEPTH_TYPE uint32_t
+#define KERNEL_DEPTH_VALUE(w) depth_to_unorm((w), setup->framebuffer.depth_scale, DEPTH_UNORM24_MAX)
+#define KERNEL_DEPTH_CLOSER(value, stored) ((value) > (stored))
+#else
+#define KERNEL_DEPTH_TYPE uint16_t
+#define KERNEL_DEPTH_VALUE(w) (uint16_t)depth_to_unorm((w), setup->framebuffer.depth_scale, DEPTH_UNORM16_MAX)
+#define KERNEL_DEPTH_CLOSER(value, stored) ((value) > (stored))
+#endif
+
+#define KERNEL_SPAN KERNEL_PASTE(KERNEL_NAME, _span)
+#define KERNEL_PLOT KERNEL_PASTE(KERNEL_NAME, _plot)
+
+// Depth test, color store and depth write of one pixel, unchecked: x is inside
+// the scissor. Returns 1 when the pixel was stored.
+static inline int KERNEL_PLOT(uint32_t* color_row, KERNEL_DEPTH_TYPE* depth_row, int x, KERNEL_DEPTH_TYPE depth, uint32_t color) {
+	if (!KERNEL_DEPTH_TEST || KERNEL_DEPTH_CLOSER(depth, depth_row[x])) {
+		color_row[x] = color;
+		if (KERNEL_DEPTH_WRITE) {
+			depth_row[x] = depth;
+		}
+		return 1;
+	}
+	return 0;
+}
+
+// Shade the pixels x_start..x_end of row y, stepping the planes of setup
+static void KERNEL_SPAN(int y, int x_start, int x_end, const triangle_setup_t* setup, pixel_counts_t* counts) {
+	if (x_start < setup->framebuffer.scissor.x0) x_start = setup->framebuffer.scissor.x0;
+	if (x_end > setup->framebuffer.scissor.x1) x_end = setup->framebuffer.scissor.x1;
+	if (x_start > x_end) {
+		return;
+	}
+	counts->tested += x_end - x_start + 1;
+#if KERNEL_SHADING == SHADE_OVERDRAW
+	uint32_t* overdraw_row = setup->overdraw + (ptrdiff_t)setup->overdraw_pitch * y;
+#elif KERNEL_SHADING == SHADE_VISIBILITY
+	uint32_t* visibility_row = setup->visibility + (ptrdiff_t)setup->visibility_pitch * y;
+#else
+	uint32_t* color_row = framebuffer_color_row(&setup->framebuffer, y);
+#endif
+	KERNEL_DEPTH_TYPE* depth_row = (KERNEL_DEPTH_TYPE*)framebuffer_depth_row(&setup->framebuffer, y);
+
+	float offset_x = x_start - setup->x0;
+	float offset_y = y - setup->y0;
+	float w = setup->w.value + setup->w.dx * offset_x + setup->w.dy * offset_y;
+#if KERNEL_SHADING == SHADE_GOURAUD
+	float shade = setup->shade.value + setup->shade.dx * offset_x + setup->shade.dy * offset_y;
+#elif KERNEL_SHADING == SHADE_TEXTURED
+	texture_t* texture = setup->texture;
+	float u = setup->u.value + setup->u.dx * offset_x + setup->u.dy * offset_y;
+	float v = setup->v.value + setup->v.dx * offset_x + setup->v.dy * offset_y;
+
+	if (texture_subdivision > TEXTURE_SUBDIVISION_EXACT) {
+		// Affine subdivision: exact u,v at both ends of each piece, linear between
+		float reciprocal = 1.0 / w;
+		float piece_u = u * reciprocal;
+		float piece_v = v * reciprocal;
+		for (int x = x_start; x <= x_end;) {
+			int length = x_end - x + 1;
+			if (length > texture_subdivision) length = texture_subdivision;
+
+			float end_u = u + setup->u.dx * length;
+			float end_v = v + setup->v.dx * length;
+			float end_w = w + setup->w.dx * length;
+			float end_reciprocal = 1.0 / end_w;
+			float next_u = end_u * end_reciprocal;
+			float next_v = end_v * end_reciprocal;
+			float step_u = (next_u - piece_u) / length;
+			float step_v = (next_v - piece_v) / length;
+
+			for (int i = 0; i < length; i++, x++) {
+				counts->written += KERNEL_PLOT(color_row, depth_row, x, KERNEL_DEPTH_VALUE(w), texture->texels[texel_index(texture, piece_u, piece_v)]);
+				piece_u += step_u;
+				piece_v += step_v;
+				w += setup->w.dx;
+			}
+
+			// Restart from the exact values so error does not build up along the span
+			piece_u = next_u;
+			piece_v = next_v;
+			u = end_u;
+			v = end_v;
+			w = end_w;
+		}
+		return;
+	}
+#endif
+
+	for (int x = x_start; x <= x_end; x++) {
+		KERNEL_DEPTH_TYPE depth = KERNEL_DEPTH_VALUE(w);
+#if KERNEL_SHADING == SHADE_TEXTURED
+		// Texel fetch and divide only for pixels that survive the depth test
+		if (!KERNEL_DEPTH_TEST || KERNEL_DEPTH_CLOSER(depth, depth_row[x])) {
+			float reciprocal = 1.0 / w;
+			color_row[x] = texture->texels[texel_index(texture, u * reciprocal, v * reciprocal)];
+			if (KERNEL_DEPTH_WRITE) {
+				depth_row[x] = depth;
+			}
+			counts->written++;
+		}
+		u += setup->u.dx;
+		v += setup->v.dx;
+#elif KERNEL_SHADING == SHADE_OVERDRAW
+		overdraw_row[x] += OVERDRAW_TEST;
+		if (!KERNEL_DEPTH_TEST || KERNEL_DEPTH_CLOSER(depth, depth_row[x])) {
+			if (KERNEL_DEPTH_WRITE) {
+				depth_row[x] = depth;
+			}
+			overdraw_row[x] += OVERDRAW_PASS;
+			counts->written++;
+		}
+#elif KERNEL_SHADING == SHADE_VISIBILITY
+		counts->written += KERNEL_PLOT(visibility_row, depth_row, x, depth, setup->visibility_id);
+#elif KERNEL_SHADING == SHADE_GOURAUD
+		counts->written += KERNEL_PLOT(color_row, depth_row, x, depth, shade_color(setup->color, shade));
+		shade += setup->shade.dx;
+#else
+		counts->written += KERNEL_PLOT(color_row, depth_row, x, depth, setup->color);
+#endif
+		w += setup->w.dx;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Fill with the flat-top/flat-bottom method: the triangle, sorted by y, is
+// split at the middle vertex into a flat-bottom and a flat-top half
+///////////////////////////////////////////////////////////////////////////////
+//
+//          (x0,y0)
+//            / \
+//           /   \
+//          /     \
+//         /       \
+//        /         \
+//   (x1,y1)------(Mx,My)
+//       \_           \
+//          \_         \
+//             \_       \
+//                \_     \
+//                   \    \
+//                     \_  \
+//                        \_\
+//                           \
+//                         (x2,y2)
+//
+///////////////////////////////////////////////////////////////////////////////
+static void KERNEL_NAME(triangle_t* triangle, texture_t* texture) {
+	triangle_setup_t setup;
+	pixel_counts_t counts = { 0, 0 };
+	if (setup_triangle(triangle, texture, KERNEL_SHADING, &setup)) {
+		int x0 = setup.x[0], y0 = setup.y[0];
+		int x1 = setup.x[1], y1 = setup.y[1];
+		int x2 = setup.x[2], y2 = setup.y[2];
+
+		///////////////////////////////////////////////////////////////////////
+		// Render upper half of triangle (flat-bottom)
+		///////////////////////////////////////////////////////////////////////
+		float inv_slope_1 = 0;
+		float inv_slope_2 = 0;
+		if (y1 - y0 != 0) inv_slope_1 = (float)(x1 - x0) / abs(y1 - y0);
+		if (y2 - y0 != 0) inv_slope_2 = (float)(x2 - x0) / abs(y2 - y0);
+		if (y1 - y0 != 0) {
+			int y_end = y1 < setup.y_max ? y1 : setup.y_max;
+			for (int y = y0 > setup.y_min ? y0 : setup.y_min; y <= y_end; y++) {
+				int x_start = x1 + (y - y1) * inv_slope_1;
+				int x_end = x0 + (y - y0) * inv_slope_2;
+
+				if (x_end < x_start) swap_int(&x_end, &x_start);
+
+				KERNEL_SPAN(y, x_start, x_end, &setup, &counts);
+			}
+		}
+		///////////////////////////////////////////////////////////////////////
+		// Render lower half of triangle (flat-top)
+		///////////////////////////////////////////////////////////////////////
+		if (y2 - y1 != 0) inv_slope_1 = (float)(x2 - x1) / abs(y2 - y1);
+		if (y2 - y0 != 0) inv_slope_2 = (float)(x2 - x0) / abs(y2 - y0);
+		if (y2 - y1 != 0) {
+			int y_end = y2 < setup.y_max ? y2 : setup.y_max;
+			for (int y = y1 > setup.y_min ? y1 : setup.y_min; y <= y_end; y++) {
+				int x_start = x1 + (y - y1) * inv_slope_1;
+				int x_end = x0 + (y - y0) * inv_slope_2;
+
+				if (x_end < x_start) swap_int(&x_end, &x_start);
+
+				KERNEL_SPAN(y, x_start, x_end, &setup, &counts);
+			}
+		}
+	}
+	profile_count(COUNTER_PIXELS_TESTED, counts.tested);
+	profile_count(COUNTER_PIXELS_WRITTEN, counts.written);
+}
+
+#undef KERNEL_SPAN
+#undef KERNEL_PLOT
+#undef KERNEL_NAME
+#undef KERNEL_DEPTH_TYPE
+#undef KERNEL_DEPTH_VALUE
+#undef KERNEL_DEPTH_CLOSER
+#undef KERNEL_DEPTH_TEST
+#undef KERNEL_DEPTH_WRITE
+
+#endif
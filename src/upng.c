@@ -28,6 +28,7 @@ freely, subject to the following restrictions:
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
+#include <stdint.h>
 
 #include "upng.h"
 
@@ -98,6 +99,8 @@ struct upng_t {
 
 	upng_state		state;
 	upng_source		source;
+
+	char			argb;	/*decode straight to native 0xAARRGGBB words (see upng_decode_argb)*/
 };
 
 typedef struct huffman_tree {
@@ -830,6 +833,101 @@ static void post_process_scanlines(upng_t* upng, unsigned char *out, unsigned ch
 	}
 }
 
+/*
+   Convert one reconstructed scanline to native-endian 0xAARRGGBB words. Every line is independent of the others.
+   The 8 bit RGBA/RGB cases are the ones our assets use; they are written as plain per-pixel shifts so the
+   compiler can vectorize them. 16 bit channels keep their most significant byte.
+ */
+static void convert_scanline_argb(const upng_t* upng, uint32_t *out, const unsigned char *line, unsigned w)
+{
+	unsigned x;
+	unsigned step = upng->color_depth / 8;	/*bytes per channel sample */
+
+	switch (upng->format) {
+	case UPNG_RGBA8:
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		/*R,G,B,A bytes load as 0xAABBGGRR: only red and blue trade places, a shuffle-free vector op*/
+		memcpy(out, line, (unsigned long)w * 4);
+		for (x = 0; x < w; x++) {
+			uint32_t p = out[x];
+			out[x] = (p & 0xFF00FF00u) | ((p & 0xFFu) << 16) | ((p >> 16) & 0xFFu);
+		}
+#else
+		for (x = 0; x < w; x++) {
+			const unsigned char *p = &line[x * 4];
+			out[x] = ((uint32_t)p[3] << 24) | ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | (uint32_t)p[2];
+		}
+#endif
+		break;
+	case UPNG_RGB8:
+		for (x = 0; x < w; x++) {
+			const unsigned char *p = &line[x * 3];
+			out[x] = 0xFF000000u | ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | (uint32_t)p[2];
+		}
+		break;
+	case UPNG_RGBA16:
+	case UPNG_RGB16: {
+		unsigned components = upng->format == UPNG_RGBA16 ? 4 : 3;
+		for (x = 0; x < w; x++) {
+			const unsigned char *p = &line[x * components * step];
+			uint32_t a = components == 4 ? p[3 * step] : 0xFF;
+			out[x] = (a << 24) | ((uint32_t)p[0] << 16) | ((uint32_t)p[step] << 8) | (uint32_t)p[2 * step];
+		}
+		break;
+	}
+	case UPNG_LUMINANCE8:
+		for (x = 0; x < w; x++) {
+			uint32_t l = line[x];
+			out[x] = 0xFF000000u | (l << 16) | (l << 8) | l;
+		}
+		break;
+	case UPNG_LUMINANCE_ALPHA8:
+		for (x = 0; x < w; x++) {
+			uint32_t l = line[x * 2];
+			out[x] = ((uint32_t)line[x * 2 + 1] << 24) | (l << 16) | (l << 8) | l;
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+/*
+   Same as unfilter, but fused with the conversion to 0xAARRGGBB: each scanline is reconstructed into a two line
+   scratch (the filters only ever look one line back) and converted into out right away, while it is still in cache.
+   The unfiltered image is never stored as a whole.
+ */
+static void unfilter_argb(upng_t* upng, uint32_t *out, const unsigned char *in, unsigned w, unsigned h, unsigned bpp)
+{
+	unsigned y;
+	unsigned char *prevline = 0;
+	unsigned char *lines;
+
+	unsigned long bytewidth = (bpp + 7) / 8;
+	unsigned long linebytes = (w * bpp + 7) / 8;
+
+	lines = (unsigned char*)malloc(linebytes * 2);
+	if (lines == NULL) {
+		SET_ERROR(upng, UPNG_ENOMEM);
+		return;
+	}
+
+	for (y = 0; y < h; y++) {
+		unsigned long inindex = (1 + linebytes) * y;
+		unsigned char *recon = &lines[linebytes * (y & 1)];
+
+		unfilter_scanline(upng, recon, &in[inindex + 1], prevline, bytewidth, in[inindex], linebytes);
+		if (upng->error != UPNG_EOK) {
+			break;
+		}
+		convert_scanline_argb(upng, &out[(unsigned long)w * y], recon, w);
+
+		prevline = recon;
+	}
+
+	free(lines);
+}
+
 static upng_format determine_format(upng_t* upng) {
 	switch (upng->color_type) {
 	case UPNG_LUM:
@@ -1086,7 +1184,11 @@ upng_error upng_decode(upng_t* upng)
 	free(compressed);
 
 	/* allocate final image buffer */
-	upng->size = (upng->height * upng->width * upng_get_bpp(upng) + 7) / 8;
+	if (upng->argb) {
+		upng->size = upng->height * upng->width * 4;
+	} else {
+		upng->size = (upng->height * upng->width * upng_get_bpp(upng) + 7) / 8;
+	}
 	upng->buffer = (unsigned char*)malloc(upng->size);
 	if (upng->buffer == NULL) {
 		free(inflated);
@@ -1096,7 +1198,11 @@ upng_error upng_decode(upng_t* upng)
 	}
 
 	/* unfilter scanlines */
-	post_process_scanlines(upng, upng->buffer, inflated, upng);
+	if (upng->argb) {
+		unfilter_argb(upng, (uint32_t*)upng->buffer, inflated, upng->width, upng->height, upng_get_bpp(upng));
+	} else {
+		post_process_scanlines(upng, upng->buffer, inflated, upng);
+	}
 	free(inflated);
 
 	if (upng->error != UPNG_EOK) {
@@ -1113,6 +1219,32 @@ upng_error upng_decode(upng_t* upng)
 	return upng->error;
 }
 
+/*decode like upng_decode, but the buffer holds width * height native-endian 0xAARRGGBB words, the layout the
+renderer and its SDL texture use. only 8 and 16 bit depths are supported by this path*/
+upng_error upng_decode_argb(upng_t* upng)
+{
+	if (upng->error != UPNG_EOK) {
+		return upng->error;
+	}
+
+	upng_header(upng);
+	if (upng->error != UPNG_EOK) {
+		return upng->error;
+	}
+
+	if (upng->color_depth != 8 && upng->color_depth != 16) {
+		SET_ERROR(upng, UPNG_EUNFORMAT);
+		return upng->error;
+	}
+	if (upng->color_depth == 16 && (upng->color_type == UPNG_LUM || upng->color_type == UPNG_LUMA)) {
+		SET_ERROR(upng, UPNG_EUNFORMAT);
+		return upng->error;
+	}
+
+	upng->argb = 1;
+	return upng_decode(upng);
+}
+
 static upng_t* upng_new(void)
 {
 	upng_t* upng;
@@ -1140,6 +1272,8 @@ static upng_t* upng_new(void)
 	upng->source.size = 0;
 	upng->source.owning = 0;
 
+	upng->argb = 0;
+
 	return upng;
 }
 
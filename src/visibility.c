@@ -0,0 +1,153 @@
+#include <stdlib.h>
+#include <string.h>
+#include "visibility.h"
+#include "array.h"
+#include "display.h"
+#include "framebuffer.h"
+#include "profiler.h"
+#include "jobs.h"
+
+static bool visibility_buffer = false;
+
+static uint32_t* ids = NULL;
+static int ids_capacity = 0;
+static int ids_pitch = 0;
+static int ids_height = 0;
+
+// Union of the bounds of the triangles since the last clear, empty when x0 > x1
+static scissor_t dirty = { 0, 0, -1, -1 };
+
+// Planes of the frame's rasterized triangles, id - 1 indexes them
+static visibility_triangle_t* triangles = NULL;
+static int num_triangles = 0;
+
+void set_visibility_buffer(bool enabled) {
+	visibility_buffer = enabled;
+}
+
+bool is_visibility_buffer_enabled(void) {
+	return visibility_buffer;
+}
+
+// Only the textured methods are deferred
+bool should_render_visibility_buffer(void) {
+	return visibility_buffer && should_render_textured_triangles();
+}
+
+// Size the ids to the frame being rendered and clear them. Called after the
+// frame's render scale is set, before the visibility kernels run. While the
+// size stays the same only the previous frame's dirty rectangle is cleared.
+void begin_visibility_frame(void) {
+	framebuffer_t framebuffer = get_framebuffer();
+	int size = framebuffer.width * framebuffer.height;
+	if (size > ids_capacity) {
+		free(ids);
+		ids = (uint32_t*)malloc(sizeof(uint32_t) * size);
+		ids_capacity = ids != NULL ? size : 0;
+		ids_pitch = 0;
+	}
+	if (ids != NULL && (framebuffer.width != ids_pitch || framebuffer.height != ids_height)) {
+		memset(ids, VISIBILITY_EMPTY, sizeof(uint32_t) * size);
+	} else if (ids != NULL) {
+		for (int y = dirty.y0; y <= dirty.y1 && dirty.x0 <= dirty.x1; y++) {
+			memset(ids + (size_t)ids_pitch * y + dirty.x0, VISIBILITY_EMPTY, sizeof(uint32_t) * (dirty.x1 - dirty.x0 + 1));
+		}
+	}
+	ids_pitch = ids != NULL ? framebuffer.width : 0;
+	ids_height = ids != NULL ? framebuffer.height : 0;
+	dirty = (scissor_t){ 0, 0, -1, -1 };
+	num_triangles = 0;
+}
+
+uint32_t* get_visibility_buffer(void) {
+	return ids;
+}
+
+int get_visibility_pitch(void) {
+	return ids_pitch;
+}
+
+// Record a triangle about to be rasterized, returns the id its pixels store
+uint32_t add_visibility_triangle(const visibility_triangle_t* triangle) {
+	if (num_triangles >= array_length(triangles)) {
+		triangles = array_hold(triangles, 1, sizeof(visibility_triangle_t));
+	}
+	triangles[num_triangles++] = *triangle;
+
+	scissor_t bounds = triangle->bounds;
+	if (dirty.x0 > dirty.x1) {
+		dirty = bounds;
+	} else {
+		if (bounds.x0 < dirty.x0) dirty.x0 = bounds.x0;
+		if (bounds.y0 < dirty.y0) dirty.y0 = bounds.y0;
+		if (bounds.x1 > dirty.x1) dirty.x1 = bounds.x1;
+		if (bounds.y1 > dirty.y1) dirty.y1 = bounds.y1;
+	}
+	return num_triangles;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Texture every covered pixel once. Along a row, neighbours usually belong to
+// the same triangle, so its planes are evaluated at the start of each run and
+// stepped by one add per pixel like the forward spans. Bands of rows are
+// resolved as jobs, which write disjoint rows.
+///////////////////////////////////////////////////////////////////////////////
+#define RESOLVE_BAND_ROWS 16
+
+static void resolve_band(int band, int worker, void* data) {
+	framebuffer_t* framebuffer = data;
+	int y0 = dirty.y0 + band * RESOLVE_BAND_ROWS;
+	int y1 = y0 + RESOLVE_BAND_ROWS - 1 < dirty.y1 ? y0 + RESOLVE_BAND_ROWS - 1 : dirty.y1;
+	int64_t resolved = 0;
+	for (int y = y0; y <= y1; y++) {
+		uint32_t* color_row = framebuffer_color_row(framebuffer, y);
+		const uint32_t* id_row = ids + (size_t)ids_pitch * y;
+		for (int x = dirty.x0; x <= dirty.x1;) {
+			uint32_t id = id_row[x];
+			if (id == VISIBILITY_EMPTY) {
+				x++;
+				continue;
+			}
+			const visibility_triangle_t* triangle = &triangles[id - 1];
+			texture_t* texture = triangle->texture;
+			float offset_x = x - triangle->x0;
+			float offset_y = y - triangle->y0;
+			float w = triangle->w.value + triangle->w.dx * offset_x + triangle->w.dy * offset_y;
+			float u = triangle->u.value + triangle->u.dx * offset_x + triangle->u.dy * offset_y;
+			float v = triangle->v.value + triangle->v.dx * offset_x + triangle->v.dy * offset_y;
+			int run_start = x;
+			for (; x <= dirty.x1 && id_row[x] == id; x++) {
+				float reciprocal = 1.0 / w;
+				color_row[x] = texture->texels[texel_index(texture, u * reciprocal, v * reciprocal)];
+				w += triangle->w.dx;
+				u += triangle->u.dx;
+				v += triangle->v.dx;
+			}
+			resolved += x - run_start;
+		}
+	}
+	profile_count(COUNTER_PIXELS_RESOLVED, resolved);
+}
+
+void resolve_visibility(void) {
+	if (ids == NULL || dirty.x0 > dirty.x1 || dirty.y0 > dirty.y1) {
+		return;
+	}
+	framebuffer_t framebuffer = get_framebuffer();
+	int num_bands = (dirty.y1 - dirty.y0) / RESOLVE_BAND_ROWS + 1;
+	job_counter_t counter = { { 0 } };
+	run_jobs("resolve band", num_bands, resolve_band, &framebuffer, &counter);
+	wait_for_jobs(&counter);
+}
+
+void free_visibility_buffers(void) {
+	free(ids);
+	array_free(triangles);
+	ids = NULL;
+	ids_capacity = 0;
+	ids_pitch = 0;
+	ids_height = 0;
+	dirty = (scissor_t){ 0, 0, -1, -1 };
+	triangles = NULL;
+	num_triangles = 0;
+}
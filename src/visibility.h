@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "triangle.h"
+#include "texture.h"
+#include "framebuffer.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// Deferred texturing through a visibility buffer (textured render methods)
+////////////////////////////////////////////////////////////////////////////////
+// The forward textured kernels interpolate u,v and fetch a texel for every
+// fragment that passes the depth test when it is drawn, so pixels drawn over
+// later are textured more than once. With the visibility buffer on, the
+// triangles are rasterized in a first pass that only depth tests and stores,
+// per pixel, the id of the triangle that covers it. Each rasterized triangle
+// records its u/w, v/w and 1/w planes and texture under its id.
+// resolve_visibility() then textures every covered pixel exactly once from the
+// planes of its triangle, so shading cost follows the covered pixels rather
+// than the overdraw. Only the rectangle the frame's triangles touched is
+// resolved, in bands of rows spread over the job system's workers, and
+// cleared again at the start of the next frame.
+//
+// The resolve divides exactly per pixel (the texture subdivision setting only
+// applies to forward spans), and wireframe edges are drawn after it rather
+// than interleaved with the triangles.
+
+// Id 0 is an empty pixel
+#define VISIBILITY_EMPTY 0
+
+typedef struct {
+	float x0, y0;				// screen position where the plane values hold
+	attribute_plane_t w;		// 1/w
+	attribute_plane_t u, v;		// u/w and v/w
+	texture_t* texture;
+	scissor_t bounds;			// pixels the triangle can cover, inside the scissor
+} visibility_triangle_t;
+
+void set_visibility_buffer(bool enabled);
+bool is_visibility_buffer_enabled(void);
+bool should_render_visibility_buffer(void);
+
+void begin_visibility_frame(void);
+uint32_t* get_visibility_buffer(void);
+int get_visibility_pitch(void);
+uint32_t add_visibility_triangle(const visibility_triangle_t* triangle);
+void resolve_visibility(void);
+void free_visibility_buffers(void);